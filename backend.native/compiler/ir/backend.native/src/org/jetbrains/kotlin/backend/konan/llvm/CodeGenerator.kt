@@ -173,12 +173,28 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         get() = (irFunction as? IrConstructor)?.constructedClass
     private var returnSlot: LLVMValueRef? = null
     private var slotsPhi: LLVMValueRef? = null
+    // Stack roots are placed after other object slots and are not reference counted for thread-local objects,
+    // runtime scans them when collecting garbage instead.
+    private var stackRootsPhi: LLVMValueRef? = null
+    private var stackRootCount = 0
+    // Memory state of the current thread, loaded once in the prologue if the function uses it,
+    // so that runtime calls below do not look it up in thread-local storage.
+    private var memoryStatePhi: LLVMValueRef? = null
+    private var memoryStateUsed = false
+    private val memoryStateType = LLVMGetReturnType(getFunctionType(context.llvm.currentMemoryStateFunction))!!
     private val frameOverlaySlotCount =
             (LLVMStoreSizeOfType(llvmTargetData, runtime.frameOverlayType) / runtime.pointerSize).toInt()
     private var slotCount = frameOverlaySlotCount
+    private val frameArenaAlignment = runtime.frameArenaType?.let {
+        maxOf(LLVMABIAlignmentOfType(llvmTargetData, it), runtime.pointerAlignment)
+    } ?: runtime.pointerAlignment
+    private val frameArenaSlotCount = runtime.frameArenaType?.let {
+        ((LLVMStoreSizeOfType(llvmTargetData, it) + runtime.pointerSize - 1) / runtime.pointerSize).toInt()
+    } ?: 0
     private var localAllocs = 0
     private var arenaSlot: LLVMValueRef? = null
     private val slotToVariableLocation = mutableMapOf<Int,VariableDebugLocation>()
+    private val stackRootToVariableLocation = mutableMapOf<Int,VariableDebugLocation>()
 
     private val prologueBb        = basicBlockInFunction("prologue", startLocation)
     private val localsInitBb      = basicBlockInFunction("locals_init", startLocation)
@@ -213,9 +229,18 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         return result
     }
 
-    fun alloca(type: LLVMTypeRef?, name: String = "", variableLocation: VariableDebugLocation? = null): LLVMValueRef {
+    fun alloca(type: LLVMTypeRef?, name: String = "", variableLocation: VariableDebugLocation? = null,
+               stackRoot: Boolean = false): LLVMValueRef {
         if (isObjectType(type!!)) {
             appendingTo(localsInitBb) {
+                if (stackRoot) {
+                    val slotAddress = gep(stackRootsPhi!!, Int32(stackRootCount).llvm, name)
+                    variableLocation?.let {
+                        stackRootToVariableLocation[stackRootCount] = it
+                    }
+                    stackRootCount++
+                    return slotAddress
+                }
                 val slotAddress = gep(slotsPhi!!, Int32(slotCount).llvm, name)
                 variableLocation?.let {
                     slotToVariableLocation[slotCount] = it
@@ -268,8 +293,8 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
     fun loadSlot(address: LLVMValueRef, isVar: Boolean, name: String = ""): LLVMValueRef {
         val value = LLVMBuildLoad(builder, address, name)!!
         if (isObjectRef(value) && isVar) {
-            val slot = alloca(LLVMTypeOf(value), variableLocation = null)
-            storeAny(value, slot)
+            val slot = alloca(LLVMTypeOf(value), variableLocation = null, stackRoot = true)
+            storeStackRoot(value, slot)
         }
         return value
     }
@@ -288,6 +313,24 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         }
     }
 
+    // Stores into a field of heap object holder.
+    fun storeHeapRef(value: LLVMValueRef, holder: LLVMValueRef, ptr: LLVMValueRef) {
+        if (isObjectRef(value)) {
+            call(context.llvm.updateHeapRefFunction, listOf(memoryState, holder, ptr, value))
+        } else {
+            LLVMBuildStore(builder, value, ptr)
+        }
+    }
+
+    // Stores into a slot allocated with alloca(stackRoot = true).
+    fun storeStackRoot(value: LLVMValueRef, ptr: LLVMValueRef) {
+        if (isObjectRef(value)) {
+            call(context.llvm.updateStackRefFunction, listOf(memoryState, ptr, value))
+        } else {
+            LLVMBuildStore(builder, value, ptr)
+        }
+    }
+
     fun freeze(value: LLVMValueRef, exceptionHandler: ExceptionHandler) {
         if (isObjectRef(value))
             call(context.llvm.freezeSubgraph, listOf(value),  Lifetime.IRRELEVANT, exceptionHandler)
@@ -298,13 +341,19 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
     }
 
     private fun updateReturnRef(value: LLVMValueRef, address: LLVMValueRef) {
-        call(context.llvm.updateReturnRefFunction, listOf(address, value))
+        call(context.llvm.updateReturnRefWithStateFunction, listOf(memoryState, address, value))
     }
 
     private fun updateRef(value: LLVMValueRef, address: LLVMValueRef) {
-        call(context.llvm.updateRefFunction, listOf(address, value))
+        call(context.llvm.updateRefWithStateFunction, listOf(memoryState, address, value))
     }
 
+    private val memoryState: LLVMValueRef
+        get() {
+            memoryStateUsed = true
+            return memoryStatePhi!!
+        }
+
     //-------------------------------------------------------------------------//
 
     fun call(llvmFunction: LLVMValueRef, args: List<LLVMValueRef>,
@@ -402,17 +451,18 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         }
     }
 
-    fun allocInstance(typeInfo: LLVMValueRef, lifetime: Lifetime): LLVMValueRef =
-            call(context.llvm.allocInstanceFunction, listOf(typeInfo), lifetime)
+    fun allocInstance(typeInfo: LLVMValueRef, lifetime: Lifetime, exceptionHandler: ExceptionHandler): LLVMValueRef =
+            call(context.llvm.allocInstanceWithStateFunction, listOf(memoryState, typeInfo), lifetime, exceptionHandler)
 
-    fun allocInstance(irClass: IrClass, lifetime: Lifetime): LLVMValueRef =
-            allocInstance(codegen.typeInfoForAllocation(irClass), lifetime)
+    fun allocInstance(irClass: IrClass, lifetime: Lifetime, exceptionHandler: ExceptionHandler): LLVMValueRef =
+            allocInstance(codegen.typeInfoForAllocation(irClass), lifetime, exceptionHandler)
 
     fun allocArray(typeInfo: LLVMValueRef,
                    count: LLVMValueRef,
                    lifetime: Lifetime,
                    exceptionHandler: ExceptionHandler): LLVMValueRef =
-            call(context.llvm.allocArrayFunction, listOf(typeInfo, count), lifetime, exceptionHandler)
+            call(context.llvm.allocArrayWithStateFunction, listOf(memoryState, typeInfo, count),
+                    lifetime, exceptionHandler)
 
     fun unreachable(): LLVMValueRef? {
         val res = LLVMBuildUnreachable(builder)
@@ -826,6 +876,8 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         }
         positionAtEnd(localsInitBb)
         slotsPhi = phi(kObjHeaderPtrPtr)
+        stackRootsPhi = phi(kObjHeaderPtrPtr)
+        memoryStatePhi = phi(memoryStateType)
         // Is removed by DCE trivially, if not needed.
         arenaSlot = intToPtr(
                 or(ptrToInt(slotsPhi, codegen.intPtrType), codegen.immOneIntPtrType), kObjHeaderPtrPtr)
@@ -833,24 +885,49 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
     }
 
     internal fun epilogue() {
+        // Frame enter and leave, and return slot update take the memory state as well.
+        val loadMemoryState = memoryStateUsed || needSlots || returnSlot != null
         appendingTo(prologueBb) {
+            val memoryState = if (loadMemoryState)
+                call(context.llvm.currentMemoryStateFunction, emptyList())
+            else
+                LLVMConstNull(memoryStateType)!!
+            addPhiIncoming(memoryStatePhi!!, prologueBb to memoryState)
+            // Frame-local arena and its first chunk are placed after object slots, so that
+            // functions with local allocations need no heap memory for the arena itself.
+            val useFrameArena = localAllocs > 0 && frameArenaSlotCount > 0
+            val slotsPerArenaAlignment = frameArenaAlignment / codegen.runtime.pointerSize
+            val frameSlotCount = slotCount + stackRootCount
+            val frameArenaOffset = (frameSlotCount + slotsPerArenaAlignment - 1) / slotsPerArenaAlignment * slotsPerArenaAlignment
+            val totalSlotCount = if (useFrameArena) frameArenaOffset + frameArenaSlotCount else frameSlotCount
             val slots = if (needSlots)
-                LLVMBuildArrayAlloca(builder, kObjHeaderPtr, Int32(slotCount).llvm, "")!!
+                LLVMBuildArrayAlloca(builder, kObjHeaderPtr, Int32(totalSlotCount).llvm, "")!!
             else
                 kNullObjHeaderPtrPtr
             if (needSlots) {
+                if (useFrameArena) LLVMSetAlignment(slots, frameArenaAlignment)
                 // Zero-init slots.
                 val slotsMem = bitcast(kInt8Ptr, slots)
                 call(context.llvm.memsetFunction,
                         listOf(slotsMem, Int8(0).llvm,
-                                Int32(slotCount * codegen.runtime.pointerSize).llvm,
+                                Int32(totalSlotCount * codegen.runtime.pointerSize).llvm,
                                 Int32(codegen.runtime.pointerAlignment).llvm,
                                 Int1(0).llvm))
-                call(context.llvm.enterFrameFunction, listOf(slots, Int32(vars.skip).llvm, Int32(slotCount).llvm))
+                if (useFrameArena) {
+                    // Runtime initializes the arena lazily, on the first allocation in it.
+                    val frameArena = bitcast(kObjHeaderPtr, gep(slots, Int32(frameArenaOffset).llvm))
+                    LLVMBuildStore(builder, frameArena, slots)
+                }
+                call(context.llvm.enterFrameFunction, listOf(memoryState, slots, Int32(vars.skip).llvm,
+                        Int32(frameSlotCount).llvm, Int32(stackRootCount).llvm))
             }
             addPhiIncoming(slotsPhi!!, prologueBb to slots)
+            addPhiIncoming(stackRootsPhi!!, prologueBb to
+                    if (needSlots) gep(slots, Int32(slotCount).llvm) else kNullObjHeaderPtrPtr)
             memScoped {
-                slotToVariableLocation.forEach { slot, variable ->
+                val variableLocations = slotToVariableLocation +
+                        stackRootToVariableLocation.mapKeys { slotCount + it.key }
+                variableLocations.forEach { slot, variable ->
                     val expr = longArrayOf(DwarfOp.DW_OP_plus_uconst.value,
                             runtime.pointerSize * slot.toLong()).toCValues()
                     DIInsertDeclaration(
@@ -937,6 +1014,9 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
         vars.clear()
         returnSlot = null
         slotsPhi = null
+        stackRootsPhi = null
+        memoryStatePhi = null
+        memoryStateUsed = false
     }
 
     //-------------------------------------------------------------------------//
@@ -1033,13 +1113,14 @@ internal class FunctionGenerationContext(val function: LLVMValueRef,
 
     private val needSlots: Boolean
         get() {
-            return slotCount > frameOverlaySlotCount || localAllocs > 0
+            return slotCount > frameOverlaySlotCount || stackRootCount > 0 || localAllocs > 0
         }
 
     private fun releaseVars() {
         if (needSlots) {
             call(context.llvm.leaveFrameFunction,
-                    listOf(slotsPhi!!, Int32(vars.skip).llvm, Int32(slotCount).llvm))
+                    listOf(memoryState, slotsPhi!!, Int32(vars.skip).llvm,
+                            Int32(slotCount + stackRootCount).llvm, Int32(stackRootCount).llvm))
         }
     }
 }
@@ -378,12 +378,16 @@ internal class Llvm(val context: Context, val llvmModule: LLVMModuleRef) {
 
     private fun importRtGlobal(name: String) = importGlobal(name, runtime.llvmModule)
 
-    val allocInstanceFunction = importRtFunction("AllocInstance")
+    val currentMemoryStateFunction = importRtFunction("CurrentMemoryState")
+    val allocInstanceWithStateFunction = importRtFunction("AllocInstanceWithState")
     val allocArrayFunction = importRtFunction("AllocArrayInstance")
+    val allocArrayWithStateFunction = importRtFunction("AllocArrayInstanceWithState")
     val initInstanceFunction = importRtFunction("InitInstance")
     val initSharedInstanceFunction = importRtFunction("InitSharedInstance")
-    val updateReturnRefFunction = importRtFunction("UpdateReturnRef")
-    val updateRefFunction = importRtFunction("UpdateRef")
+    val updateReturnRefWithStateFunction = importRtFunction("UpdateReturnRefWithState")
+    val updateRefWithStateFunction = importRtFunction("UpdateRefWithState")
+    val updateStackRefFunction = importRtFunction("UpdateStackRef")
+    val updateHeapRefFunction = importRtFunction("UpdateHeapRef")
     val enterFrameFunction = importRtFunction("EnterFrame")
     val leaveFrameFunction = importRtFunction("LeaveFrame")
     val getReturnSlotIfArenaFunction = importRtFunction("GetReturnSlotIfArena")
@@ -289,7 +289,7 @@ internal class IntrinsicGenerator(private val environment: IntrinsicGeneratorEnv
         val typeParameterT = context.ir.symbols.createUninitializedInstance.descriptor.typeParameters[0]
         val enumClass = callSite.getTypeArgument(typeParameterT)!!
         val enumIrClass = enumClass.getClass()!!
-        return allocInstance(enumIrClass, environment.calculateLifetime(callSite))
+        return allocInstance(enumIrClass, environment.calculateLifetime(callSite), environment.exceptionHandler)
     }
 
     private fun FunctionGenerationContext.emitGetPointerSize(): LLVMValueRef =
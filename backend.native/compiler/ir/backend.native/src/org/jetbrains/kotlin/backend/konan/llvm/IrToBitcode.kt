@@ -1456,7 +1456,7 @@ internal class CodeGeneratorVisitor(val context: Context, val lifetimes: Map<IrE
                         listOf(functionGenerationContext.bitcast(codegen.kObjHeaderPtr, thisPtr)),
                         Lifetime.IRRELEVANT, ExceptionHandler.Caller)
             }
-            functionGenerationContext.storeAny(valueToAssign, fieldPtrOfClass(thisPtr, value.symbol.owner))
+            functionGenerationContext.storeHeapRef(valueToAssign, thisPtr, fieldPtrOfClass(thisPtr, value.symbol.owner))
         } else {
             assert(value.receiver == null)
             val globalValue = context.llvmDeclarations.forStaticField(value.symbol.owner).storage
@@ -2084,7 +2084,8 @@ internal class CodeGeneratorVisitor(val context: Context, val lifetimes: Map<IrE
                     callDirect(symbols.interopObjCRelease.owner, listOf(rawPtr), Lifetime.IRRELEVANT)
                 }
             } else {
-                functionGenerationContext.allocInstance(constructedClass, resultLifetime(callee))
+                functionGenerationContext.allocInstance(constructedClass, resultLifetime(callee),
+                        currentCodeContext.exceptionHandler)
             }
             evaluateSimpleFunctionCall(callee.symbol.owner,
                     listOf(thisValue) + args, Lifetime.IRRELEVANT /* constructor doesn't return anything */)
@@ -30,6 +30,8 @@ class Runtime(bitcodeFile: String) {
     val arrayHeaderType = getStructType("ArrayHeader")
 
     val frameOverlayType = getStructType("FrameOverlay")
+    // Present only if the runtime supports placing frame-local arenas in the frame itself.
+    val frameArenaType = getStructTypeOrNull("FrameArena")
 
     val target = LLVMGetTarget(llvmModule)!!.toKString()
 
@@ -22,9 +22,14 @@ internal class VariableManager(val functionGenerationContext: FunctionGeneration
         fun address() : LLVMValueRef
     }
 
-    inner class SlotRecord(val address: LLVMValueRef, val refSlot: Boolean, val isVar: Boolean) : Record {
+    inner class SlotRecord(val address: LLVMValueRef, val refSlot: Boolean, val isVar: Boolean,
+                           val stackRoot: Boolean = false) : Record {
         override fun load() : LLVMValueRef = functionGenerationContext.loadSlot(address, isVar)
-        override fun store(value: LLVMValueRef) = functionGenerationContext.storeAny(value, address)
+        override fun store(value: LLVMValueRef) =
+                if (stackRoot)
+                    functionGenerationContext.storeStackRoot(value, address)
+                else
+                    functionGenerationContext.storeAny(value, address)
         override fun address() : LLVMValueRef = this.address
         override fun toString() = (if (refSlot) "refslot" else "slot") + " for ${address}"
     }
@@ -70,10 +75,12 @@ internal class VariableManager(val functionGenerationContext: FunctionGeneration
         assert(!contextVariablesToIndex.contains(valueDeclaration))
         val index = variables.size
         val type = functionGenerationContext.getLLVMType(valueDeclaration.type)
-        val slot = functionGenerationContext.alloca(type, valueDeclaration.name.asString(), variableLocation)
+        // Named variables are stack roots, see FunctionGenerationContext.alloca().
+        val slot = functionGenerationContext.alloca(type, valueDeclaration.name.asString(), variableLocation,
+                stackRoot = true)
         if (value != null)
-            functionGenerationContext.storeAny(value, slot)
-        variables.add(SlotRecord(slot, functionGenerationContext.isObjectType(type), isVar))
+            functionGenerationContext.storeStackRoot(value, slot)
+        variables.add(SlotRecord(slot, functionGenerationContext.isObjectType(type), isVar, stackRoot = true))
         contextVariablesToIndex[valueDeclaration] = index
         return index
     }
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+
+class Item(val value: Int, val next: Item?)
+
+fun churn(seed: Int): Int {
+    var result = 0
+    for (round in 0 until 1000) {
+        var list: Item? = null
+        for (i in 0 until 100) list = Item(seed + i, list)
+        result += list!!.value
+    }
+    return result
+}
+
+fun main(args: Array<String>) {
+    // Results are allocated by the workers and released by the main thread, so per worker counters
+    // only balance in the total checked for leaks at exit.
+    val workers = Array(4) { Worker.start() }
+    val futures = Array(workers.size) { index ->
+        workers[index].execute(TransferMode.SAFE, { index }) { input ->
+            churn(input)
+            IntArray(1000) { input }
+        }
+    }
+    var sum = 0
+    for (future in futures) {
+        future.consume { result -> for (value in result) sum += value }
+    }
+    println(sum)
+    for (worker in workers) {
+        worker.requestTermination().result
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+
+// Keeps allocated objects on the heap.
+var sink: Any? = null
+var kept: Any? = null
+
+fun weight(profile: String, className: String) =
+        profile.split('\n').filter { it.contains(className) }.map { it.substringAfterLast(' ').toLong() }.sum()
+
+fun main(args: Array<String>) {
+    // Sample every allocation.
+    GC.startAllocationProfiler(1)
+    for (i in 0 until 100) {
+        sink = ByteArray(1000)
+    }
+    kept = IntArray(10)
+    sink = null
+    GC.collect()
+    GC.stopAllocationProfiler()
+    val profile = GC.allocationProfile()
+    val live = GC.allocationProfile(live = true)
+    println(weight(profile, "kotlin.ByteArray") >= 100 * 1000)
+    println(weight(live, "kotlin.ByteArray") == 0L)
+    println(weight(live, "kotlin.IntArray") > 0)
+}
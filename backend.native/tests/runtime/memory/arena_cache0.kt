@@ -0,0 +1,36 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+// Array does not escape, so it could be placed in the frame arena, whose chunks are cached when the frame is left.
+fun sumLocal(size: Int): Long {
+    val array = LongArray(size)
+    for (i in 0 until size) array[i] = i.toLong()
+    var sum = 0L
+    for (element in array) sum += element
+    return sum
+}
+
+// All arrays are placed in the same arena, so its chunks grow.
+fun sumSeveral(count: Int, size: Int): Long {
+    var sum = 0L
+    for (i in 0 until count) {
+        val array = IntArray(size)
+        array[size - 1] = i
+        sum += array[size - 1] + array[0]
+    }
+    return sum
+}
+
+fun main(args: Array<String>) {
+    var total = 0L
+    for (round in 0 until 100) {
+        for (size in intArrayOf(1, 100, 1000, 10000, 100000)) {
+            total += sumLocal(size)
+        }
+    }
+    println(total)
+    println(sumSeveral(1000, 500))
+    println(sumSeveral(10, 20000))
+}
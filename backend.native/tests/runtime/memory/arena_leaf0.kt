@@ -0,0 +1,46 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+import kotlin.native.ref.WeakReference
+
+class Leaf(val value: Int)
+
+class Data(val value: Int)
+
+class Box(val target: Data)
+
+// Arena holds only objects without references, so its fields are not traversed on teardown.
+fun leafOnly(i: Int): Int {
+    val bytes = ByteArray(16)
+    bytes[i % 16] = i.toByte()
+    val leaf = Leaf(i)
+    return leaf.value + bytes[i % 16]
+}
+
+// Arena holds an object referring to the heap, which must still be released on teardown.
+fun withReference(weak: Array<WeakReference<Data>?>, i: Int): Int {
+    val target = Data(i)
+    weak[i] = WeakReference(target)
+    val box = Box(target)
+    return box.target.value + 1
+}
+
+fun main(args: Array<String>) {
+    var sum = 0
+    for (i in 0 until 1000) sum += leafOnly(i)
+    println(sum)
+
+    val weak = arrayOfNulls<WeakReference<Data>>(100)
+    sum = 0
+    for (i in 0 until 100) sum += withReference(weak, i)
+    println(sum)
+    GC.collect()
+    var cleared = 0
+    for (reference in weak) {
+        if (reference!!.get() == null) cleared++
+    }
+    println(cleared)
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+
+class Holder(val data: ByteArray) {
+    var next: Holder? = null
+}
+
+var sink: Holder? = null
+
+fun main(args: Array<String>) {
+    println(GC.backgroundFree)
+    GC.backgroundFree = true
+    println(GC.backgroundFree)
+    val freedBefore = GC.backgroundFreedBlocks
+    var sum = 0L
+    for (i in 0 until 5000) {
+        // Cycles of objects too large for size classes, released by GC in bulk.
+        val holder = Holder(ByteArray(if (i % 1000 == 0) 300 * 1024 else 2048))
+        holder.next = Holder(ByteArray(4096))
+        holder.next!!.next = holder
+        holder.data[0] = i.toByte()
+        sum += holder.data[0]
+        sink = holder
+    }
+    sink = null
+    GC.collect()
+    println(sum)
+    // Waits till the background thread frees all queued blocks.
+    GC.trim()
+    // Both byte arrays of each iteration, but the last one, possibly still referenced from the stack.
+    println(GC.backgroundFreedBlocks - freedBefore >= 2 * 4999)
+    GC.backgroundFree = false
+    println(GC.backgroundFree)
+}
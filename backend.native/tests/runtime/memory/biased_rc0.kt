@@ -0,0 +1,42 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlin.native.internal.*
+import kotlin.native.ref.*
+
+class Data(val value: Int)
+
+fun sum(table: Array<Data>): Int {
+    var result = 0
+    for (data in table) result += data.value
+    return result
+}
+
+fun makeWeak(): WeakReference<Data> {
+    val data = Data(42).freeze()
+    return WeakReference(data)
+}
+
+fun main(args: Array<String>) {
+    val table = Array(100) { Data(it) }.freeze()
+    var total = 0
+    repeat(100) { total += sum(table) }
+    println(total)
+
+    val worker = Worker.start()
+    val future = worker.execute(TransferMode.SAFE, { table }) {
+        var result = 0
+        repeat(100) { result += sum(it) }
+        result
+    }
+    repeat(100) { total += sum(table) }
+    println(future.result + total)
+    worker.requestTermination().result
+
+    // Frozen garbage is not kept alive by stack references once they are gone.
+    val weak = makeWeak()
+    println(weak.get() == null)
+}
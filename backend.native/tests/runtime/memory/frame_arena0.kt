@@ -0,0 +1,42 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+class Point(val x: Int, val y: Int)
+
+// Local objects could be placed in the arena living in the frame itself.
+fun local(x: Int, y: Int): Int {
+    val p = Point(x, y)
+    val q = Point(y, x)
+    return p.x + q.x
+}
+
+fun recursive(n: Int): Int {
+    val p = Point(n, n)
+    return if (n == 0) p.x else recursive(n - 1) + p.y
+}
+
+// Frame with arena is left by an exception.
+fun throwing(n: Int): Int {
+    val p = Point(n, 0)
+    if (n % 2 == 0) throw IllegalStateException()
+    return p.x
+}
+
+fun main(args: Array<String>) {
+    var sum = 0L
+    for (x in 0 until 100000) sum += local(x, 1)
+    println(sum)
+    println(recursive(1000))
+    var thrown = 0
+    var returned = 0
+    for (n in 0 until 1000) {
+        try {
+            returned += throwing(n)
+        } catch (e: IllegalStateException) {
+            thrown++
+        }
+    }
+    println("$thrown $returned")
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+import kotlinx.cinterop.*
+import platform.posix.*
+
+class Node(var next: Node?)
+
+// Keeps allocated objects on the heap.
+var sink: Any? = null
+
+fun readLines(path: String): List<String> {
+    val file = fopen(path, "r") ?: return emptyList()
+    val lines = mutableListOf<String>()
+    try {
+        memScoped {
+            val buffer = allocArray<ByteVar>(1024)
+            while (fgets(buffer, 1024, file) != null) {
+                lines.add(buffer.toKString().trimEnd())
+            }
+        }
+    } finally {
+        fclose(file)
+    }
+    return lines
+}
+
+fun main(args: Array<String>) {
+    val path = "heap_dump0.txt"
+    // Not tracked yet.
+    println(GC.dumpHeap(path))
+    GC.trackContainers = true
+    sink = Node(Node(null))
+    println(GC.dumpHeap(path))
+    GC.trackContainers = false
+    val nodes = readLines(path).filter { it.contains(" Node ") }
+    remove(path)
+    println(nodes.size)
+    // Only the outer node refers to another object.
+    println(nodes.count { it.split(' ').size == 6 })
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+
+// Keeps allocated arrays on the heap.
+var sink: Any? = null
+
+fun main(args: Array<String>) {
+    GC.heapQuota = 4L * 1024 * 1024
+    val arrays = mutableListOf<ByteArray>()
+    sink = arrays
+    try {
+        while (true) {
+            arrays.add(ByteArray(64 * 1024))
+        }
+    } catch (e: OutOfMemoryError) {
+        println("OutOfMemoryError")
+    }
+    arrays.clear()
+    sink = null
+    // Memory released by the list can be allocated again.
+    val array = ByteArray(1024 * 1024)
+    GC.heapQuota = 0
+    println(if (array.size == 1024 * 1024) "OK" else "FAIL")
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+
+class Node(var next: Node?)
+
+// Keep allocated objects on the heap.
+var kept: Any? = null
+var sink: Any? = null
+
+fun main(args: Array<String>) {
+    println(GC.typeHistogram().size)
+    GC.trackContainers = true
+    for (i in 0 until 10) {
+        kept = Node(kept as Node?)
+    }
+    for (i in 0 until 5) {
+        sink = Node(null)
+    }
+    sink = null
+    val node = GC.typeHistogram(1000).single { it.className == "Node" }
+    GC.trackContainers = false
+    println(node.liveCount)
+    println(node.allocCount)
+    println(node.liveBytes > 0)
+}
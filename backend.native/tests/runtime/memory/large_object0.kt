@@ -0,0 +1,33 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+
+var sink: ByteArray? = null
+
+fun main(args: Array<String>) {
+    GC.collect()
+    val usedBefore = GC.heapUsed
+    var zeroed = true
+    for (i in 0 until 20) {
+        // Mapped memory must be zeroed even when reused after a previous large array died.
+        val array = ByteArray(1024 * 1024 + i)
+        for (j in 0 until array.size) {
+            if (array[j] != 0.toByte()) zeroed = false
+            array[j] = -1
+        }
+        sink = array
+    }
+    println(zeroed)
+    println(GC.heapUsed - usedBefore >= 1024 * 1024)
+    sink = null
+    GC.collect()
+    println(GC.heapUsed - usedBefore < 1024 * 1024)
+
+    val doubles = DoubleArray(300 * 1024) { it.toDouble() }
+    var sum = 0.0
+    for (d in doubles) sum += d
+    println(sum.toLong())
+}
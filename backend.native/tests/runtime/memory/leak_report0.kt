@@ -0,0 +1,25 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlin.native.internal.*
+
+class Node(var next: Node?)
+
+fun main(args: Array<String>) {
+    GC.reportLeaks = true
+    println(GC.trackContainers)
+    val worker = Worker.start()
+    // Cycle is collected by the final GC of the worker, so nothing is reported.
+    val future = worker.execute(TransferMode.SAFE, { Unit }) {
+        val node = Node(null)
+        node.next = Node(node)
+        node.next != null
+    }
+    println(future.result)
+    worker.requestTermination().result
+    GC.trackContainers = false
+    println(GC.reportLeaks)
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+import kotlin.native.ref.WeakReference
+
+data class Data(val value: Int)
+
+fun makeWeak(count: Int) = Array(count) { WeakReference(Data(it)) }
+
+fun main(args: Array<String>) {
+    // Meta-objects of released weak references go back to the pool and are reused by the next round.
+    var alive = 0
+    for (round in 0 until 100) {
+        val strong = Array(100) { Data(round * 100 + it) }
+        val weak = Array(100) { WeakReference(strong[it]) }
+        GC.collect()
+        for (i in 0 until 100) {
+            if (weak[i].get() === strong[i]) alive++
+        }
+    }
+    println(alive)
+
+    val weak = makeWeak(1000)
+    GC.collect()
+    var cleared = 0
+    for (reference in weak) {
+        if (reference.get() == null) cleared++
+    }
+    println(cleared)
+}
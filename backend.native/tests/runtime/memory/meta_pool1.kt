@@ -0,0 +1,43 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import cforeignthread.*
+import kotlinx.cinterop.*
+import kotlin.native.concurrent.*
+import kotlin.native.internal.GC
+import kotlin.native.ref.WeakReference
+
+class Data(val value: Int)
+
+fun touchOnPlainThread(data: Data): WeakReference<Data> {
+    val ref = StableRef.create(data)
+    // Meta-object is not taken from the pool of the worker, as the plain thread has none.
+    ensureNeverFrozenOnPlainThread(ref.asCPointer())
+    ref.dispose()
+    return WeakReference(data)
+}
+
+fun main(args: Array<String>) {
+    val data = Array(100) { Data(it) }
+    val weak = Array(100) { touchOnPlainThread(data[it]) }
+    var blocked = 0
+    for (item in data) {
+        try {
+            item.freeze()
+        } catch (e: FreezingException) {
+            blocked++
+        }
+    }
+    println(blocked)
+
+    // Meta-objects allocated on the plain thread are released by the worker.
+    for (i in 0 until data.size) data[i] = Data(i)
+    GC.collect()
+    var cleared = 0
+    for (reference in weak) {
+        if (reference.get() == null) cleared++
+    }
+    println(cleared)
+}
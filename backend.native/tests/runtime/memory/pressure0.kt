@@ -0,0 +1,30 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+import kotlin.native.internal.MemoryPressure
+
+// Keeps allocated arrays on the heap.
+var sink: Any? = null
+
+fun allocate() {
+    val arrays = mutableListOf<ByteArray>()
+    sink = arrays
+    for (i in 0 until 64) {
+        arrays.add(ByteArray(32 * 1024))
+    }
+    sink = null
+}
+
+fun main(args: Array<String>) {
+    GC.addMemoryPressureListener { level: MemoryPressure -> println(level) }
+    GC.softMemoryLimit = 1
+    allocate()
+    GC.hardMemoryLimit = 1
+    allocate()
+    GC.softMemoryLimit = Long.MAX_VALUE
+    GC.hardMemoryLimit = Long.MAX_VALUE
+    allocate()
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+
+class Node(var next: Node?, val payload: IntArray)
+
+var sink: Node? = null
+
+// Garbage cycles are freed by GC through the finalizer queue, which keeps their containers for reuse.
+fun churn(size: Int) {
+    for (i in 0 until 1000) {
+        val first = Node(null, IntArray(size) { -1 })
+        first.next = Node(first, IntArray(size / 2 + 1) { -1 })
+        sink = first
+    }
+    sink = null
+    GC.collect()
+}
+
+// Containers taken for reuse must look freshly allocated.
+fun check(size: Int): Boolean {
+    var ok = true
+    for (i in 0 until 1000) {
+        val node = Node(null, IntArray(size))
+        sink = node
+        for (element in node.payload) {
+            if (element != 0) ok = false
+        }
+        if (node.next != null) ok = false
+    }
+    sink = null
+    return ok
+}
+
+fun main(args: Array<String>) {
+    var ok = true
+    for (size in intArrayOf(1, 7, 30, 100, 500)) {
+        churn(size)
+        ok = check(size) && check(size / 2 + 1) && ok
+    }
+    println(ok)
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlin.native.internal.GC
+import kotlin.native.ref.WeakReference
+
+class Node(val id: Int) {
+    var next: Node? = null
+    var other: Node? = null
+}
+
+// Cycles through every node, and crosswise, so that collection and freezing have to walk the whole graph.
+fun ring(size: Int): Node {
+    val nodes = Array(size) { Node(it) }
+    for (i in 0 until size) {
+        nodes[i].next = nodes[(i + 1) % size]
+        nodes[i].other = nodes[(i + size / 2) % size]
+    }
+    return nodes[0]
+}
+
+fun count(head: Node): Int {
+    var result = 1
+    var node = head.next!!
+    while (node !== head) {
+        result++
+        node = node.next!!
+    }
+    return result
+}
+
+fun weakRing(size: Int) = WeakReference(ring(size))
+
+fun main(args: Array<String>) {
+    // Scratch memory is reset between passes, so do each twice.
+    var collected = true
+    for (round in 0 until 2) {
+        val weak = weakRing(100000)
+        GC.collect()
+        if (weak.get() != null) collected = false
+    }
+    println(collected)
+
+    for (round in 0 until 2) {
+        val frozen = ring(100000).freeze()
+        if (round == 0) {
+            println(frozen.isFrozen && frozen.other!!.isFrozen)
+            println(count(frozen))
+        }
+    }
+
+    val attached = DetachedObjectGraph { ring(10000) }.attach()
+    println(count(attached))
+}
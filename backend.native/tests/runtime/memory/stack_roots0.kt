@@ -0,0 +1,67 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlin.native.internal.*
+import kotlin.native.ref.*
+
+class Node(var next: Node?)
+
+// Keeps allocated objects on the heap.
+var sink: Any? = null
+
+fun makeCycle(): WeakReference<Node> {
+    var node = Node(null)
+    node.next = Node(node)
+    return WeakReference(node)
+}
+
+fun unwindWithStackRoots(depth: Int, refs: MutableList<WeakReference<Node>>): Int {
+    var node = Node(null)
+    node.next = Node(node)
+    refs.add(WeakReference(node))
+    if (depth == 0) {
+        // Stack roots of all frames below keep their cycles alive.
+        GC.collect()
+        if (refs.any { it.get() == null }) return -1
+        throw IllegalStateException()
+    }
+    return unwindWithStackRoots(depth - 1, refs) + 1
+}
+
+fun main(args: Array<String>) {
+    var count = 0
+    var node: Node? = null
+    for (i in 0 until 10000) {
+        // Previous node is referenced from the local variable only.
+        node = Node(node?.let { Node(null) })
+        if (node.next != null) count++
+    }
+    println(count)
+
+    val weak = makeCycle()
+    GC.collect()
+    println(weak.get() == null)
+
+    var local = Node(Node(null))
+    sink = local
+    sink = null
+    GC.collect()
+    local.freeze()
+    GC.collect()
+    println(local.isFrozen && local.next != null)
+    local = Node(null)
+    GC.collect()
+    println(local.next == null)
+
+    val refs = mutableListOf<WeakReference<Node>>()
+    try {
+        println(unwindWithStackRoots(10, refs))
+    } catch (e: IllegalStateException) {
+        // Frames left by the exception no longer keep their stack roots.
+        GC.collect()
+        println(refs.size == 11 && refs.all { it.get() == null })
+    }
+}
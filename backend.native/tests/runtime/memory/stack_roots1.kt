@@ -0,0 +1,37 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+
+class Node(val value: Int, var next: Node?)
+
+// Releases many containers, which are referenced from the local variable only.
+fun churn(count: Int): Int {
+    var sum = 0
+    var node: Node? = null
+    for (i in 0 until count) {
+        node = Node(i % 10, null)
+        sum += node.value
+    }
+    return sum
+}
+
+// Every frame keeps a fresh local object, which is referenced from stack roots only.
+fun recursive(depth: Int, count: Int): Int {
+    val local = Node(1, null)
+    val result = if (depth == 0) churn(count) else recursive(depth - 1, count)
+    return result + local.value
+}
+
+fun main(args: Array<String>) {
+    // Stack-only containers of all frames outnumber the GC threshold.
+    println(recursive(10000, 100000))
+
+    // While GC is stopped, such containers are freed without looking at the stack on each release.
+    GC.stop()
+    println(recursive(1000, 100000))
+    GC.start()
+    GC.collect()
+}
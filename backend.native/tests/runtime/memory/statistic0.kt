@@ -0,0 +1,29 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.*
+
+class Node(var next: Node?)
+
+// Keeps allocated objects on the heap.
+var sink: Any? = null
+
+fun main(args: Array<String>) {
+    GC.collectStatistic = true
+    for (i in 0 until 100) {
+        val node = Node(null)
+        node.next = Node(node)
+        sink = node
+    }
+    sink = null
+    GC.collect()
+    GC.collectStatistic = false
+    val statistic = GC.statistic()!!
+    println(statistic.containerAllocs(ContainerKind.NORMAL) >= 200)
+    println(statistic.gcRuns >= 1)
+    println(statistic.freedBytes > 0)
+    // Containers are counted as normal ones, when allocated.
+    println(statistic.allocationSizes.sum() == statistic.containerAllocs(ContainerKind.NORMAL))
+}
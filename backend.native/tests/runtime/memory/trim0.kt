@@ -0,0 +1,16 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+fun main(args: Array<String>) {
+    var sum = 0
+    for (i in 0 until 100) {
+        val array = IntArray(10000 + i)
+        array[i] = i
+        sum += array[i]
+    }
+    kotlin.native.internal.GC.collect()
+    kotlin.native.internal.GC.trim()
+    println(sum)
+}
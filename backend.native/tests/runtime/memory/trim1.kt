@@ -0,0 +1,34 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.internal.GC
+
+fun allocate(count: Int): Array<Any?> {
+    val objects = arrayOfNulls<Any?>(count)
+    for (i in 0 until count) {
+        objects[i] = when (i % 4) {
+            0 -> ByteArray(i % 700)
+            1 -> IntArray(i % 150)
+            2 -> Any()
+            else -> i.toString()
+        }
+    }
+    return objects
+}
+
+fun main(args: Array<String>) {
+    GC.collect()
+    GC.trim()
+    val before = GC.heapReserved
+    var objects: Array<Any?>? = allocate(100000)
+    val peak = GC.heapReserved
+    println(peak > before)
+    println((objects!![400] as ByteArray).size)
+    objects = null
+    GC.collect()
+    GC.trim()
+    // Chunks of small objects are returned to the system, once all their objects are freed.
+    println(GC.heapReserved - before < (peak - before) / 4)
+}
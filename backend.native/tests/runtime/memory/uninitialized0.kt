@@ -0,0 +1,93 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.*
+import kotlin.native.internal.GC
+
+var sinkChars: CharArray? = null
+var sinkBytes: ByteArray? = null
+
+// Leaves garbage in freed memory, so that elements not written after allocation without zeroing are noticed.
+fun dirty() {
+    for (size in 0 until 300) {
+        sinkChars = CharArray(size) { '\uFFFF' }
+        sinkBytes = ByteArray(size * 2) { -1 }
+    }
+    sinkChars = null
+    sinkBytes = null
+    GC.collect()
+}
+
+fun check(n: Int): Boolean {
+    var ok = true
+    val chars = CharArray(n) { 'a' + it % 26 }
+
+    val string = String(chars)
+    val fromChars = String(chars, n / 2, n - n / 2)
+    val toChars = string.toCharArray()
+    val plus = string + "!"
+    val sub = plus.substring(n / 2)
+    val upper = string.toUpperCase()
+    val lower = upper.toLowerCase()
+    val replaced = string.replace('a', 'A')
+    val copy = chars.copyOf(n + 10)
+    val utf8 = (string + "é").toUtf8()
+    val decoded = utf8.stringFromUtf8()
+
+    if (string.length != n || toChars.size != n || upper.length != n || lower.length != n || replaced.length != n)
+        return false
+    for (i in 0 until n) {
+        val c = chars[i]
+        if (string[i] != c || toChars[i] != c || plus[i] != c || lower[i] != c || decoded[i] != c) ok = false
+        if (upper[i] != c.toUpperCase()) ok = false
+        if (replaced[i] != (if (c == 'a') 'A' else c)) ok = false
+        if (copy[i] != c) ok = false
+        if (utf8[i] != c.toByte()) ok = false
+    }
+    if (fromChars.length != n - n / 2) return false
+    for (i in 0 until fromChars.length) {
+        if (fromChars[i] != chars[n / 2 + i]) ok = false
+    }
+    if (plus.length != n + 1 || plus[n] != '!') ok = false
+    if (sub.length != n + 1 - n / 2) return false
+    for (i in 0 until sub.length) {
+        if (sub[i] != plus[n / 2 + i]) ok = false
+    }
+    if (copy.size != n + 10) return false
+    for (i in n until n + 10) {
+        if (copy[i] != '\u0000') ok = false
+    }
+    if (utf8.size != n + 2 || utf8[n] != 0xc3.toByte() || utf8[n + 1] != 0xa9.toByte()) ok = false
+    if (decoded.length != n + 1 || decoded[n] != 'é') ok = false
+    return ok
+}
+
+fun checkBlob(): Boolean {
+    val blob = immutableBlobOf(1, 2, 3, 4, 5, 0xff)
+    val all = blob.toByteArray()
+    val part = blob.toByteArray(1, 4)
+    val expected = byteArrayOf(1, 2, 3, 4, 5, -1)
+    if (all.size != 6 || part.size != 3) return false
+    for (i in 0 until 6) {
+        if (all[i] != expected[i]) return false
+    }
+    for (i in 0 until 3) {
+        if (part[i] != expected[i + 1]) return false
+    }
+    return true
+}
+
+fun main(args: Array<String>) {
+    var ok = true
+    for (round in 0 until 3) {
+        dirty()
+        for (n in 0 until 300) {
+            ok = check(n) && ok
+        }
+    }
+    println(ok)
+    dirty()
+    println(checkBlob())
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlin.native.internal.*
+import kotlin.native.ref.*
+
+class Data(val value: Int)
+
+class Holder(var data: Data?)
+
+// Keeps allocated objects on the heap.
+var sink: Any? = null
+
+fun overwrite(holder: Holder, array: Array<Data?>): WeakReference<Data> {
+    val first = Data(-1)
+    holder.data = first
+    for (i in 0 until 1000) {
+        holder.data = Data(i)
+        array[i % array.size] = holder.data
+    }
+    return WeakReference(first)
+}
+
+fun main(args: Array<String>) {
+    val holder = Holder(null)
+    val array = arrayOfNulls<Data>(100)
+    val weak = overwrite(holder, array)
+    GC.collect()
+    println(weak.get() == null)
+    println(holder.data!!.value)
+    println(array.sumBy { it!!.value })
+
+    val shared = Data(42).freeze()
+    holder.data = Data(0)
+    holder.data = shared
+    array.fill(shared)
+    sink = holder
+    holder.freeze()
+    GC.collect()
+    println(holder.data!!.value + array[99]!!.value)
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2010-2018 JetBrains s.r.o. Use of this source code is governed by the Apache 2.0 license
+ * that can be found in the LICENSE file.
+ */
+
+import kotlin.native.concurrent.*
+import kotlinx.cinterop.*
+
+fun main(args: Array<String>) {
+    // Shared object, whose buffer field is replaced by workers as it grows.
+    val data = MutableData()
+    val workers = Array(4) { Worker.start() }
+    val futures = workers.mapIndexed { index, worker ->
+        worker.execute(TransferMode.SAFE, { Pair(data, index).freeze() }) { (data, index) ->
+            val bytes = ByteArray(10) { index.toByte() }
+            for (i in 0 until 1000) {
+                bytes.usePinned { data.append(it.addressOf(0), bytes.size) }
+            }
+        }
+    }
+    futures.forEach { it.result }
+    workers.forEach { it.requestTermination().result }
+    println(data.size)
+    var sum = 0
+    data.withBufferLocked { array, size ->
+        for (i in 0 until size) sum += array[i]
+    }
+    println(sum)
+}
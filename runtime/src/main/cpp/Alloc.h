@@ -29,6 +29,11 @@ inline void* konanAllocMemory(size_t size) {
   return konan::calloc(1, size);
 }
 
+// Memory is not zeroed, so the caller is responsible for initializing it.
+inline void* konanAllocUninitializedMemory(size_t size) {
+  return konan::malloc(size);
+}
+
 inline void konanFreeMemory(void* memory) {
   konan::free(memory);
 }
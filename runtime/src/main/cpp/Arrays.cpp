@@ -92,7 +92,7 @@ void Kotlin_Array_set(KRef thiz, KInt index, KConstRef value) {
     ThrowArrayIndexOutOfBoundsException();
   }
   mutabilityCheck(thiz);
-  UpdateRef(ArrayAddressOfElementAt(array, index), value);
+  UpdateHeapRef(CurrentMemoryState(), thiz, ArrayAddressOfElementAt(array, index), value);
 }
 
 KInt Kotlin_Array_getArrayLength(KConstRef thiz) {
@@ -106,8 +106,9 @@ void Kotlin_Array_fillImpl(KRef thiz, KInt fromIndex, KInt toIndex, KRef value)
     ThrowArrayIndexOutOfBoundsException();
   }
   mutabilityCheck(thiz);
+  auto state = CurrentMemoryState();
   for (KInt index = fromIndex; index < toIndex; ++index) {
-    UpdateRef(ArrayAddressOfElementAt(array, index), value);
+    UpdateHeapRef(state, thiz, ArrayAddressOfElementAt(array, index), value);
   }
 }
 
@@ -121,15 +122,16 @@ void Kotlin_Array_copyImpl(KConstRef thiz, KInt fromIndex,
     ThrowArrayIndexOutOfBoundsException();
   }
   mutabilityCheck(destination);
+  auto state = CurrentMemoryState();
   if (fromIndex >= toIndex) {
     for (int index = 0; index < count; index++) {
-      UpdateRef(ArrayAddressOfElementAt(destinationArray, toIndex + index),
-                      *ArrayAddressOfElementAt(array, fromIndex + index));
+      UpdateHeapRef(state, destination, ArrayAddressOfElementAt(destinationArray, toIndex + index),
+                    *ArrayAddressOfElementAt(array, fromIndex + index));
     }
   } else {
     for (int index = count - 1; index >= 0; index--) {
-      UpdateRef(ArrayAddressOfElementAt(destinationArray, toIndex + index),
-                      *ArrayAddressOfElementAt(array, fromIndex + index));
+      UpdateHeapRef(state, destination, ArrayAddressOfElementAt(destinationArray, toIndex + index),
+                    *ArrayAddressOfElementAt(array, fromIndex + index));
     }
   }
 }
@@ -443,13 +445,17 @@ OBJ_GETTER(Kotlin_CharArray_copyOf, KConstRef thiz, KInt newSize) {
   if (newSize < 0) {
     ThrowIllegalArgumentException();
   }
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       array->type_info(), newSize, OBJ_RESULT)->array();
   KInt toCopy = array->count_ < newSize ?  array->count_ : newSize;
   memcpy(
       PrimitiveArrayAddressOfElementAt<KChar>(result, 0),
       PrimitiveArrayAddressOfElementAt<KChar>(array, 0),
       toCopy * sizeof(KChar));
+  memset(
+      PrimitiveArrayAddressOfElementAt<KChar>(result, toCopy),
+      0,
+      (newSize - toCopy) * sizeof(KChar));
   RETURN_OBJ(result->obj());
 }
 
@@ -606,7 +612,7 @@ OBJ_GETTER(Kotlin_ImmutableBlob_toByteArray, KConstRef thiz, KInt startIndex, KI
       ThrowArrayIndexOutOfBoundsException();
   }
   KInt count = endIndex - startIndex;
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       theByteArrayTypeInfo, count, OBJ_RESULT)->array();
   memcpy(PrimitiveArrayAddressOfElementAt<KByte>(result, 0),
          PrimitiveArrayAddressOfElementAt<KByte>(array, startIndex),
@@ -96,6 +96,32 @@ _Unwind_Reason_Code depthCountCallback(
   return _URC_NO_REASON;
 }
 
+struct AddressBacktrace {
+  void** buffer;
+  int size;
+  int maxSize;
+  int skipCount;
+};
+
+_Unwind_Reason_Code addressUnwindCallback(
+    struct _Unwind_Context* context, void* arg) {
+  AddressBacktrace* backtrace = reinterpret_cast<AddressBacktrace*>(arg);
+  if (backtrace->skipCount > 0) {
+    backtrace->skipCount--;
+    return _URC_NO_REASON;
+  }
+  if (backtrace->size == backtrace->maxSize) return _URC_END_OF_STACK;
+
+#if (__MINGW32__ || __MINGW64__)
+  _Unwind_Ptr address = _Unwind_GetRegionStart(context);
+#else
+  _Unwind_Ptr address = _Unwind_GetIP(context);
+#endif
+  backtrace->buffer[backtrace->size++] = reinterpret_cast<void*>(address);
+
+  return _URC_NO_REASON;
+}
+
 _Unwind_Reason_Code unwindCallback(
     struct _Unwind_Context* context, void* arg) {
   Backtrace* backtrace = reinterpret_cast<Backtrace*>(arg);
@@ -153,6 +179,54 @@ OBJ_GETTER0(GetCurrentStackTrace) {
 #endif  // !OMIT_BACKTRACE
 }
 
+int GetCurrentStackTraceAddresses(void** buffer, int maxSize, int skipFrames) {
+#if OMIT_BACKTRACE
+  return 0;
+#else
+  // Skip this function as well.
+  skipFrames++;
+#if USE_GCC_UNWIND
+  AddressBacktrace backtrace = { buffer, 0, maxSize, skipFrames };
+  _Unwind_Backtrace(addressUnwindCallback, &backtrace);
+  return backtrace.size;
+#else
+  const int maxDepth = 64;
+  void* addresses[maxDepth];
+  int size = backtrace(addresses, maxDepth) - skipFrames;
+  if (size <= 0) return 0;
+  if (size > maxSize) size = maxSize;
+  memcpy(buffer, addresses + skipFrames, size * sizeof(void*));
+  return size;
+#endif
+#endif  // !OMIT_BACKTRACE
+}
+
+void GetStackTraceAddressString(void* address, char* buffer, size_t bufferSize) {
+#if OMIT_BACKTRACE
+  konan::snprintf(buffer, bufferSize - 1, "%p", address);
+#elif USE_GCC_UNWIND
+  char symbol[512];
+  if (!AddressToSymbol(address, symbol, sizeof(symbol))) {
+    symbol[0] = '\0';
+  }
+  konan::snprintf(buffer, bufferSize - 1, "%s (%p)", symbol, address);
+#else
+  char** symbols = backtrace_symbols(&address, 1);
+  if (symbols == nullptr) {
+    konan::snprintf(buffer, bufferSize - 1, "%p", address);
+    return;
+  }
+  AutoFree autoFree(symbols);
+  auto sourceInfo = Kotlin_getSourceInfo(address);
+  if (sourceInfo.fileName != nullptr && sourceInfo.lineNumber != -1) {
+    konan::snprintf(buffer, bufferSize - 1, "%s (%s:%d:%d)",
+                    symbols[0], sourceInfo.fileName, sourceInfo.lineNumber, sourceInfo.column);
+  } else {
+    konan::snprintf(buffer, bufferSize - 1, "%s", symbols[0]);
+  }
+#endif
+}
+
 OBJ_GETTER(GetStackTraceStrings, KConstRef stackTrace) {
 #if OMIT_BACKTRACE
   ObjHeader* result = AllocArrayInstance(theArrayTypeInfo, 1, OBJ_RESULT);
@@ -28,6 +28,13 @@ OBJ_GETTER0(GetCurrentStackTrace);
 
 OBJ_GETTER(GetStackTraceStrings, KConstRef stackTrace);
 
+// Stores up to maxSize addresses of the current stack, skipping skipFrames innermost frames, to buffer
+// and returns number of stored addresses. Unlike GetCurrentStackTrace(), doesn't allocate objects.
+int GetCurrentStackTraceAddresses(void** buffer, int maxSize, int skipFrames);
+
+// Writes human readable description of the stack trace address to buffer.
+void GetStackTraceAddressString(void* address, char* buffer, size_t bufferSize);
+
 // Throws arbitrary exception.
 void ThrowException(KRef exception);
 
@@ -41,7 +41,7 @@ KStdStringInserter utf16toUtf8OrThrow(const KChar* start, const KChar* end, KStd
 
 template<utf8to16 conversion>
 OBJ_GETTER(utf8ToUtf16Impl, const char* rawString, const char* end, uint32_t charCount) {
-  ArrayHeader* result = AllocArrayInstance(theStringTypeInfo, charCount, OBJ_RESULT)->array();
+  ArrayHeader* result = AllocArrayInstanceUninitialized(theStringTypeInfo, charCount, OBJ_RESULT)->array();
   KChar* rawResult = CharArrayAddressOfElementAt(result, 0);
   auto convertResult = conversion(rawString, end, rawResult);
   RETURN_OBJ(result->obj());
@@ -56,7 +56,7 @@ OBJ_GETTER(utf16ToUtf8Impl, KString thiz, KInt start, KInt size) {
   const KChar* utf16 = CharArrayAddressOfElementAt(thiz, start);
   KStdString utf8;
   conversion(utf16, utf16 + size, back_inserter(utf8));
-  ArrayHeader* result = AllocArrayInstance(theByteArrayTypeInfo, utf8.size(), OBJ_RESULT)->array();
+  ArrayHeader* result = AllocArrayInstanceUninitialized(theByteArrayTypeInfo, utf8.size(), OBJ_RESULT)->array();
   ::memcpy(ByteArrayAddressOfElementAt(result, 0), utf8.c_str(), utf8.size());
   RETURN_OBJ(result->obj());
 }
@@ -823,7 +823,7 @@ OBJ_GETTER(Kotlin_String_fromCharArray, KConstRef thiz, KInt start, KInt size) {
     RETURN_RESULT_OF0(TheEmptyString);
   }
 
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       theStringTypeInfo, size, OBJ_RESULT)->array();
   memcpy(CharArrayAddressOfElementAt(result, 0),
          CharArrayAddressOfElementAt(array, start),
@@ -832,7 +832,7 @@ OBJ_GETTER(Kotlin_String_fromCharArray, KConstRef thiz, KInt start, KInt size) {
 }
 
 OBJ_GETTER(Kotlin_String_toCharArray, KString string) {
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
     theCharArrayTypeInfo, string->count_, OBJ_RESULT)->array();
   memcpy(CharArrayAddressOfElementAt(result, 0),
          CharArrayAddressOfElementAt(string, 0),
@@ -849,7 +849,7 @@ OBJ_GETTER(Kotlin_String_plusImpl, KString thiz, KString other) {
   if (result_length < thiz->count_ || result_length < other->count_) {
     ThrowArrayIndexOutOfBoundsException();
   }
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
     theStringTypeInfo, result_length, OBJ_RESULT)->array();
   memcpy(
       CharArrayAddressOfElementAt(result, 0),
@@ -916,7 +916,7 @@ KBoolean Kotlin_String_equalsIgnoreCase(KString thiz, KConstRef other) {
 OBJ_GETTER(Kotlin_String_replace, KString thiz, KChar oldChar, KChar newChar,
            KBoolean ignoreCase) {
   auto count = thiz->count_;
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       theStringTypeInfo, count, OBJ_RESULT)->array();
   const KChar* thizRaw = CharArrayAddressOfElementAt(thiz, 0);
   KChar* resultRaw = CharArrayAddressOfElementAt(result, 0);
@@ -937,7 +937,7 @@ OBJ_GETTER(Kotlin_String_replace, KString thiz, KChar oldChar, KChar newChar,
 
 OBJ_GETTER(Kotlin_String_toUpperCase, KString thiz) {
   auto count = thiz->count_;
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       theStringTypeInfo, count, OBJ_RESULT)->array();
   const KChar* thizRaw = CharArrayAddressOfElementAt(thiz, 0);
   KChar* resultRaw = CharArrayAddressOfElementAt(result, 0);
@@ -949,7 +949,7 @@ OBJ_GETTER(Kotlin_String_toUpperCase, KString thiz) {
 
 OBJ_GETTER(Kotlin_String_toLowerCase, KString thiz) {
   auto count = thiz->count_;
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
       theStringTypeInfo, count, OBJ_RESULT)->array();
   const KChar* thizRaw = CharArrayAddressOfElementAt(thiz, 0);
   KChar* resultRaw = CharArrayAddressOfElementAt(result, 0);
@@ -1176,7 +1176,7 @@ OBJ_GETTER(Kotlin_String_subSequence, KString thiz, KInt startIndex, KInt endInd
     RETURN_RESULT_OF0(TheEmptyString);
   }
   KInt length = endIndex - startIndex;
-  ArrayHeader* result = AllocArrayInstance(
+  ArrayHeader* result = AllocArrayInstanceUninitialized(
     theStringTypeInfo, length, OBJ_RESULT)->array();
   memcpy(CharArrayAddressOfElementAt(result, 0),
          CharArrayAddressOfElementAt(thiz, startIndex),
@@ -14,11 +14,17 @@
  * limitations under the License.
  */
 
+#include <math.h>
 #include <string.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <cstddef> // for offsetof
 
+#ifndef KONAN_NO_THREADS
+#include <pthread.h>
+#endif
+
 #include "Alloc.h"
 #include "KAssert.h"
 #include "Atomic.h"
@@ -36,20 +42,82 @@
 #define USE_GC 1
 // Define to 1 to print all memory operations.
 #define TRACE_MEMORY 0
-// Collect memory manager events statistics.
-#define COLLECT_STATISTIC 0
+// Compile in memory manager events statistics, collected once enabled with GC.collectStatistic.
+#define COLLECT_STATISTIC 1
 // Auto-adjust GC thresholds.
 #define GC_ERGONOMICS 1
+// Allocate small containers from thread-local size-class free lists instead of konan::calloc().
+#define USE_SIZE_CLASS_ALLOCATOR 1
+// Let the compiler place frame-local arena and its first chunk in the frame itself.
+#define USE_FRAME_ARENA 1
+// Map large containers directly from the system, and unmap them once freed.
+#define USE_LARGE_OBJECT_SPACE 1
+// Allocate temporary containers of GC, freezing and subgraph transfer from a per-worker scratch arena.
+#define USE_SCRATCH_ARENA 1
+// Compile in sampling allocation profiler, started with GC.startAllocationProfiler().
+#define USE_ALLOCATION_PROFILER 1
+// Compile in registry of live heap containers, maintained once enabled with GC.trackContainers,
+// so that heap could be dumped, and leaks could be reported once enabled with GC.reportLeaks.
+#define USE_CONTAINER_REGISTRY 1
+// Let GC.backgroundFree hand blocks of freed large containers to a background thread, where threads are available.
+#if KONAN_NO_THREADS
+#define USE_BACKGROUND_FREE 0
+#else
+#define USE_BACKGROUND_FREE 1
+#endif
+// Do not reference count thread-local objects in stack roots of frames (local variables), see UpdateStackRef().
+// Containers once referenced from the stack are freed by GC, when no references are left.
+#define USE_DEFERRED_STACK_RC 1
+
+// Defer reference counting of heap stores to a per-worker log, which coalesces stores to the same location,
+// see UpdateHeapRef().
+#define USE_WRITE_LOG 1
+// Count references from stack roots to shareable objects without atomic operations, see SharedRefCache.
+#if KONAN_NO_THREADS
+#define USE_BIASED_RC 0
+#else
+#define USE_BIASED_RC 1
+#endif
+
+#if USE_DEFERRED_STACK_RC && !USE_GC
+#error "Deferred stack reference counting relies on GC"
+#endif
+#if USE_WRITE_LOG && !USE_GC
+#error "Write log is flushed by GC"
+#endif
+#if USE_BIASED_RC && !USE_DEFERRED_STACK_RC
+#error "Biased reference counting relies on stack roots"
+#endif
+#if USE_BACKGROUND_FREE && KONAN_INTERNAL_DLMALLOC
+#error "Background freeing relies on thread-safe system malloc"
+#endif
 
 namespace {
 
 // Granularity of arena container chunks.
 constexpr container_size_t kContainerAlignment = 1024;
+// Arena chunk size is doubled with every new chunk of the same arena, up to this value.
+constexpr container_size_t kMaxArenaChunkSize = 64 * 1024;
+// Freed arena chunks are kept for reuse, unless they are larger than this.
+constexpr container_size_t kMaxCachedArenaChunkSize = kMaxArenaChunkSize;
+// Total size of arena chunks cached by a single memory state.
+constexpr size_t kMaxArenaChunkCacheSize = 256 * 1024;
 // Single object alignment.
 constexpr container_size_t kObjectAlignment = 8;
 
 // Required e.g. for object size computations to be correct.
 static_assert(sizeof(ContainerHeader) % kObjectAlignment == 0, "sizeof(ContainerHeader) is not aligned");
+// Any smaller header would be padded to the object alignment anyway.
+static_assert(sizeof(ContainerHeader) == kObjectAlignment, "ContainerHeader shall take single alignment unit");
+static_assert(sizeof(ContainerChunk) % kObjectAlignment == 0, "sizeof(ContainerChunk) is not aligned");
+
+inline void lock(KInt* spinlock) {
+  while (compareAndSwap(spinlock, 0, 1) != 0) {}
+}
+
+inline void unlock(KInt* spinlock) {
+  RuntimeCheck(compareAndSwap(spinlock, 1, 0) == 1, "Must succeed");
+}
 
 #if TRACE_MEMORY
 #define MEMORY_LOG(...) konan::consolePrintf(__VA_ARGS__);
@@ -57,6 +125,19 @@ static_assert(sizeof(ContainerHeader) % kObjectAlignment == 0, "sizeof(Container
 #define MEMORY_LOG(...)
 #endif
 
+// Trim memory after GC, if collected garbage returned at least that much memory to malloc heap.
+constexpr size_t kGcTrimThreshold = 16 * 1024 * 1024;
+// Trim memory when worker becomes idle, if at least that much memory was returned to malloc heap.
+constexpr size_t kIdleTrimThreshold = 1024 * 1024;
+// Memory usage is compared with memory pressure limits every time worker allocates that much.
+constexpr int64_t kMemoryPressureCheckInterval = 1024 * 1024;
+
+enum MemoryPressureLevel {
+  MEMORY_PRESSURE_NORMAL = 0,
+  MEMORY_PRESSURE_SOFT = 1,
+  MEMORY_PRESSURE_HARD = 2
+};
+
 #if USE_GC
 // Collection threshold default (collect after having so many elements in the
 // release candidates set).
@@ -69,10 +150,67 @@ constexpr double kGcToComputeRatioThreshold = 0.5;
 // Never exceed this value when increasing GC threshold.
 constexpr size_t kMaxErgonomicThreshold = 1024 * 1024;
 #endif  // GC_ERGONOMICS
+// GC threshold is divided by this value under soft memory pressure, and set to its minimum
+// under hard memory pressure.
+constexpr size_t kSoftPressureGcThresholdDivisor = 4;
+constexpr size_t kMinPressureGcThreshold = 256;
+#endif
+
+// Containers up to this size are recycled by size class, larger ones go directly to konan::calloc().
+constexpr size_t kMaxSizeClassSize = 1024;
+// Size classes are spaced by kObjectAlignment, class 0 is reserved to denote large containers.
+constexpr int kSizeClassCount = kMaxSizeClassSize / kObjectAlignment + 1;
+#if USE_SIZE_CLASS_ALLOCATOR
+// Size of the memory chunk small containers are carved from.
+constexpr size_t kSizeClassChunkSize = 64 * 1024;
+#endif
+#if USE_SCRATCH_ARENA
+// Size of the first scratch arena chunk, next chunks are doubled up to the maximal size,
+// unless larger block is requested.
+constexpr size_t kScratchChunkSize = 64 * 1024;
+constexpr size_t kMaxScratchChunkSize = 4 * 1024 * 1024;
+#endif
+#if USE_WRITE_LOG
+// Number of distinct locations logged before the write log is flushed.
+constexpr int kWriteLogSize = 64;
+// Write log index has twice as many slots as the log has entries.
+constexpr int kWriteLogIndexBits = 7;
+constexpr int kWriteLogIndexSize = 1 << kWriteLogIndexBits;
+static_assert(kWriteLogIndexSize >= 2 * kWriteLogSize, "Write log index is too small");
+// Number of containers whose count reached zero while the log was not empty, kept till the log is flushed.
+constexpr int kWriteLogZeroCountSize = 256;
+#endif
+#if USE_BIASED_RC
+// Number of shareable containers a worker could reference from the stack without atomic operations.
+constexpr int kSharedRefCacheBits = 7;
+constexpr int kSharedRefCacheSize = 1 << kSharedRefCacheBits;
+#endif
+#if USE_BACKGROUND_FREE
+// Worker hands blocks to the background freeing thread once it has collected that many.
+constexpr int kBackgroundFreeBatchSize = 1024;
+#endif
 
-typedef KStdDeque<ContainerHeader*> ContainerHeaderDeque;
+#if USE_LARGE_OBJECT_SPACE
+// Containers of this size and larger are placed in the large object space.
+constexpr size_t kLargeObjectThreshold = 256 * 1024;
+// Large objects of this size and larger are backed by huge pages, where supported.
+constexpr size_t kLargeObjectHugePageThreshold = 2 * 1024 * 1024;
+// Marks dead large object container, instead of its size class, see prepareContainerForRelease().
+constexpr int kLargeObjectSizeClass = kSizeClassCount;
+
+inline bool isLargeObjectSize(size_t size) {
+  return size >= kLargeObjectThreshold;
+}
 #endif
 
+inline bool isSmallSize(size_t size) {
+  return size <= kMaxSizeClassSize;
+}
+
+inline int sizeClassOf(size_t size) {
+  return size / kObjectAlignment;
+}
+
 }  // namespace
 
 #if TRACE_MEMORY || USE_GC
@@ -83,6 +221,13 @@ typedef KStdVector<KRef*> KRefPtrList;
 
 struct FrameOverlay {
   ArenaContainer* arena;
+#if USE_DEFERRED_STACK_RC
+  // Frames of a thread are linked, so that GC could scan their stack roots.
+  FrameOverlay* previous;
+  // Number of slots in the frame, including this overlay, the last stackRootCount of them are stack roots.
+  int32_t count;
+  int32_t stackRootCount;
+#endif
 };
 
 // A little hack that allows to enable -O2 optimizations
@@ -91,28 +236,469 @@ struct FrameOverlay {
 // Can be removed when FrameOverlay will become more complex.
 FrameOverlay exportFrameOverlay;
 
-// Current number of allocated containers.
-int allocCount = 0;
+#if USE_FRAME_ARENA
+// Size of the arena chunk placed in the frame.
+constexpr container_size_t kFrameArenaChunkSize = 256;
+
+// Storage for frame-local arena, reserved by the compiler after object slots of frames
+// having local allocations. FrameOverlay::arena points here, and the storage is zeroed,
+// so arena is initialized on the first allocation.
+struct FrameArena {
+  ArenaContainer arena;
+  ContainerChunk chunk;
+  uint8_t chunkData[kFrameArenaChunkSize - sizeof(ContainerChunk)];
+};
+
+// Makes FrameArena type visible to the compiler, see exportFrameOverlay.
+FrameArena exportFrameArena;
+#endif
+
+// Number of containers allocated minus number of containers released by terminated workers,
+// see MemoryState::allocCount.
+int finishedWorkersAllocCount = 0;
 int aliveMemoryStatesCount = 0;
 
 // Forward declarations.
-void FreeContainer(ContainerHeader* header);
+void FreeContainer(MemoryState* state, ContainerHeader* header);
+#if USE_WRITE_LOG
+void FlushWriteLog(MemoryState* state);
+#endif
+
+#if USE_LARGE_OBJECT_SPACE
+// Space for large containers, which are mapped directly from the system, so that they do not
+// fragment malloc heap and their memory is returned to the system once freed. Large objects
+// could be freed by any thread, so the registry of all large objects is global.
+class LargeObjectSpace {
+ public:
+  // Returns zero-initialized container of the given size, or nullptr.
+  static ContainerHeader* alloc(size_t size) {
+    size_t mappedSize = sizeof(LargeObject) + size;
+    auto* object = reinterpret_cast<LargeObject*>(
+        konan::mapMemory(mappedSize, mappedSize >= kLargeObjectHugePageThreshold));
+    bool mapped = object != nullptr;
+    // Fallback for platforms without memory mapping.
+    if (!mapped) object = reinterpret_cast<LargeObject*>(konanAllocMemory(mappedSize));
+    if (object == nullptr) return nullptr;
+    object->size = mappedSize;
+    object->mapped = mapped;
+    lock(&lock_);
+    object->prev = nullptr;
+    object->next = head_;
+    if (head_ != nullptr) head_->prev = object;
+    head_ = object;
+    count_++;
+    bytes_ += mappedSize;
+    unlock(&lock_);
+    return object->container();
+  }
+
+  static void free(ContainerHeader* container) {
+    auto* object = reinterpret_cast<LargeObject*>(container) - 1;
+    lock(&lock_);
+    if (object->prev != nullptr) object->prev->next = object->next; else head_ = object->next;
+    if (object->next != nullptr) object->next->prev = object->prev;
+    count_--;
+    bytes_ -= object->size;
+    unlock(&lock_);
+    if (object->mapped)
+      konan::unmapMemory(object, object->size);
+    else
+      konanFreeMemory(object);
+  }
+
+  // Number of live large objects.
+  static size_t count() {
+    return count_;
+  }
+
+  // Memory taken by live large objects, including registry overhead.
+  static size_t bytes() {
+    return bytes_;
+  }
+
+  // Calls process for container of every live large object. Note that registry is locked,
+  // so process shall not allocate or free large objects.
+  template <typename func>
+  static void forEach(func process) {
+    lock(&lock_);
+    for (auto* object = head_; object != nullptr; object = object->next)
+      process(object->container());
+    unlock(&lock_);
+  }
+
+ private:
+  // Precedes container of every large object.
+  struct alignas(8) LargeObject {
+    LargeObject* prev;
+    LargeObject* next;
+    size_t size;
+    bool mapped;
+
+    ContainerHeader* container() {
+      return reinterpret_cast<ContainerHeader*>(this + 1);
+    }
+  };
+
+  static LargeObject* head_;
+  static size_t count_;
+  static size_t bytes_;
+  static KInt lock_;
+};
+
+LargeObjectSpace::LargeObject* LargeObjectSpace::head_ = nullptr;
+size_t LargeObjectSpace::count_ = 0;
+size_t LargeObjectSpace::bytes_ = 0;
+KInt LargeObjectSpace::lock_ = 0;
+#endif  // USE_LARGE_OBJECT_SPACE
+
+#if USE_BACKGROUND_FREE
+// Frees memory of released containers too large for the size-class allocator on a background
+// thread, so that releasing lots of garbage at once does not stall the mutator. Workers collect
+// blocks into batches linked via ContainerHeader::nextLink() and hand them over in bulk.
+// Blocks are already finalized, only their size class is read, see prepareContainerForRelease().
+// Only blocks of system malloc and of the large object space are accepted, as both are thread-safe.
+class BackgroundFreer {
+ public:
+  static bool enabled() {
+    return enabled_;
+  }
+
+  static void setEnabled(bool value) {
+    if (value) {
+      pthread_mutex_lock(&mutex_);
+      if (!started_)
+        started_ = pthread_create(&thread_, nullptr, threadRoutine, nullptr) == 0;
+      value = started_;
+      pthread_mutex_unlock(&mutex_);
+    }
+    enabled_ = value;
+  }
+
+  // Frees all submitted blocks and joins the thread. Called once the last worker is gone.
+  static void stop() {
+    enabled_ = false;
+    pthread_mutex_lock(&mutex_);
+    bool started = started_;
+    stopping_ = true;
+    pthread_cond_signal(&pendingCond_);
+    pthread_mutex_unlock(&mutex_);
+    if (started) pthread_join(thread_, nullptr);
+    pthread_mutex_lock(&mutex_);
+    started_ = stopping_ = false;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Whether memory of a released container of the given size class shall be freed in background.
+  // Small containers are recycled by the worker itself, which is cheap.
+  static bool accepts(int sizeClass) {
+#if !USE_SIZE_CLASS_ALLOCATOR
+    return true;
+#elif USE_LARGE_OBJECT_SPACE
+    return sizeClass == 0 || sizeClass == kLargeObjectSizeClass;
+#else
+    return sizeClass == 0;
+#endif
+  }
+
+  // Hands the batch from first to last over to the background thread.
+  static void submit(ContainerHeader* first, ContainerHeader* last) {
+    pthread_mutex_lock(&mutex_);
+    last->setNextLink(pending_);
+    pending_ = first;
+    pthread_cond_signal(&pendingCond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Waits until all submitted blocks are freed.
+  static void drain() {
+    pthread_mutex_lock(&mutex_);
+    while (pending_ != nullptr || busy_)
+      pthread_cond_wait(&idleCond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Number of blocks freed so far, see GC.backgroundFreedBlocks.
+  static int64_t freedBlocks() {
+    pthread_mutex_lock(&mutex_);
+    int64_t result = freedBlocks_;
+    pthread_mutex_unlock(&mutex_);
+    return result;
+  }
+
+ private:
+  static void free(ContainerHeader* container) {
+    RuntimeAssert(accepts(container->objectCount()), "Block of the size-class allocator must be freed by worker");
+#if USE_LARGE_OBJECT_SPACE
+    if (container->objectCount() == kLargeObjectSizeClass) {
+      LargeObjectSpace::free(container);
+      return;
+    }
+#endif
+    konanFreeMemory(container);
+  }
+
+  static void* threadRoutine(void*) {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (pending_ == nullptr && !stopping_)
+        pthread_cond_wait(&pendingCond_, &mutex_);
+      if (pending_ == nullptr) break;
+      auto* container = pending_;
+      pending_ = nullptr;
+      busy_ = true;
+      pthread_mutex_unlock(&mutex_);
+      int64_t freed = 0;
+      while (container != nullptr) {
+        auto* next = container->nextLink();
+        free(container);
+        container = next;
+        freed++;
+      }
+      pthread_mutex_lock(&mutex_);
+      freedBlocks_ += freed;
+      busy_ = false;
+      if (pending_ == nullptr) pthread_cond_broadcast(&idleCond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+    return nullptr;
+  }
+
+  static volatile bool enabled_;
+  static bool started_;
+  static bool stopping_;
+  static bool busy_;
+  static pthread_t thread_;
+  static int64_t freedBlocks_;
+  static ContainerHeader* pending_;
+  static pthread_mutex_t mutex_;
+  static pthread_cond_t pendingCond_;
+  static pthread_cond_t idleCond_;
+};
+
+volatile bool BackgroundFreer::enabled_ = false;
+bool BackgroundFreer::started_ = false;
+bool BackgroundFreer::stopping_ = false;
+bool BackgroundFreer::busy_ = false;
+pthread_t BackgroundFreer::thread_;
+int64_t BackgroundFreer::freedBlocks_ = 0;
+ContainerHeader* BackgroundFreer::pending_ = nullptr;
+pthread_mutex_t BackgroundFreer::mutex_ = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t BackgroundFreer::pendingCond_ = PTHREAD_COND_INITIALIZER;
+pthread_cond_t BackgroundFreer::idleCond_ = PTHREAD_COND_INITIALIZER;
+#endif  // USE_BACKGROUND_FREE
+
+// Appends fully qualified name of the class, without allocating objects.
+inline void appendTypeName(KStdString& result, const TypeInfo* typeInfo) {
+  if (typeInfo->relativeName_ == nullptr) {
+    result += "<anonymous>";
+    return;
+  }
+  if (typeInfo->packageName_ != nullptr) {
+    char* packageName = CreateCStringFromString(typeInfo->packageName_);
+    if (*packageName != '\0') {
+      result += packageName;
+      result += '.';
+    }
+    DisposeCString(packageName);
+  }
+  char* relativeName = CreateCStringFromString(typeInfo->relativeName_);
+  result += relativeName;
+  DisposeCString(relativeName);
+}
+
+#if USE_ALLOCATION_PROFILER
+// Sampling allocation profiler. Distance in bytes between samples taken by a worker follows
+// exponential distribution with mean of the sampling interval, so every allocated byte has the
+// same chance to be sampled, and each sample stands for size / (1 - exp(-size / interval)) bytes.
+// Samples are global, as containers could be freed by a worker other than the allocating one.
+class AllocationProfiler {
+ public:
+  // Per-worker sampling state.
+  struct Sampler {
+    int64_t bytesUntilSample;
+    uint32_t seed;
+    uint32_t generation;
+  };
+
+  static bool enabled() {
+    return enabled_;
+  }
+
+  static void start(int64_t interval) {
+    lock(&lock_);
+    if (samples_ == nullptr) {
+      samples_ = konanConstructInstance<KStdVector<Sample>>();
+      liveSamples_ = konanConstructInstance<KStdUnorderedMap<ContainerHeader*, size_t>>();
+    }
+    samples_->clear();
+    liveSamples_->clear();
+    liveSampleCount_ = 0;
+    interval_ = interval;
+    // Makes all workers draw new sampling distance.
+    generation_++;
+    enabled_ = true;
+    unlock(&lock_);
+  }
+
+  // Stops sampling, but keeps tracking of live samples, so that profile could still be obtained.
+  static void stop() {
+    enabled_ = false;
+  }
+
+  // Accounts allocation of size bytes, and samples it if sampling distance is reached.
+  static void allocated(Sampler* sampler, ContainerHeader* container, size_t size, const TypeInfo* typeInfo) {
+    if (sampler->generation != generation_) {
+      sampler->generation = generation_;
+      sampler->seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(sampler) >> 4) | 1;
+      sampler->bytesUntilSample = nextSampleDistance(sampler);
+    }
+    sampler->bytesUntilSample -= size;
+    if (sampler->bytesUntilSample > 0) return;
+    sampler->bytesUntilSample = nextSampleDistance(sampler);
+    record(container, size, typeInfo);
+  }
+
+  static bool hasLiveSamples() {
+    return liveSampleCount_ != 0;
+  }
+
+  // Called when container memory is released.
+  static void released(ContainerHeader* container) {
+    lock(&lock_);
+    auto it = liveSamples_->find(container);
+    if (it != liveSamples_->end()) {
+      (*samples_)[it->second].container = nullptr;
+      liveSamples_->erase(it);
+      liveSampleCount_--;
+    }
+    unlock(&lock_);
+  }
+
+  // Appends profile in collapsed stack format, i.e. line per distinct stack with semicolon separated
+  // frames from the outermost one, and the name of allocated class as the innermost frame, followed by
+  // the estimated number of bytes allocated there. If live is true, only samples not freed yet are reported.
+  static void profile(KStdString& result, bool live) {
+    KStdVector<std::pair<KStdString, double>> stacks;
+    KStdUnorderedMap<void*, KStdString> symbols;
+    char line[1024];
+    lock(&lock_);
+    if (samples_ != nullptr) {
+      for (auto& sample : *samples_) {
+        if (live && sample.container == nullptr) continue;
+        KStdString stack;
+        for (int index = sample.depth - 1; index >= 0; index--) {
+          auto it = symbols.find(sample.frames[index]);
+          if (it == symbols.end()) {
+            GetStackTraceAddressString(sample.frames[index], line, sizeof(line));
+            // Semicolons separate frames.
+            for (char* c = line; *c != '\0'; c++) if (*c == ';') *c = ',';
+            it = symbols.emplace(sample.frames[index], line).first;
+          }
+          stack += it->second;
+          stack += ';';
+        }
+        appendTypeName(stack, sample.typeInfo);
+        double size = static_cast<double>(sample.size);
+        stacks.emplace_back(std::move(stack), size / (1 - exp(-size / interval_)));
+      }
+    }
+    unlock(&lock_);
+    // Merge samples with the same stack.
+    std::sort(stacks.begin(), stacks.end());
+    for (size_t index = 0; index < stacks.size();) {
+      double weight = 0;
+      size_t next = index;
+      for (; next < stacks.size() && stacks[next].first == stacks[index].first; next++)
+        weight += stacks[next].second;
+      konan::snprintf(line, sizeof(line) - 1, " %lld\n", static_cast<long long>(weight + 0.5));
+      result += stacks[index].first;
+      result += line;
+      index = next;
+    }
+  }
+
+ private:
+  static constexpr int kMaxStackDepth = 64;
+  // Samples over this number are dropped.
+  static constexpr size_t kMaxSamples = 64 * 1024;
+
+  struct Sample {
+    const TypeInfo* typeInfo;
+    size_t size;
+    // Null once freed.
+    ContainerHeader* container;
+    int depth;
+    void* frames[kMaxStackDepth];
+  };
+
+  static int64_t nextSampleDistance(Sampler* sampler) {
+    // xorshift32.
+    uint32_t x = sampler->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sampler->seed = x;
+    // Uniform in (0, 1].
+    double uniform = ((x >> 8) + 1) / static_cast<double>(1 << 24);
+    return static_cast<int64_t>(-log(uniform) * interval_) + 1;
+  }
+
+  static void record(ContainerHeader* container, size_t size, const TypeInfo* typeInfo) {
+    Sample sample;
+    sample.typeInfo = typeInfo;
+    sample.size = size;
+    sample.container = container;
+    // Skip profiler itself.
+    sample.depth = GetCurrentStackTraceAddresses(sample.frames, kMaxStackDepth, 2);
+    lock(&lock_);
+    if (enabled_ && samples_->size() < kMaxSamples) {
+      (*liveSamples_)[container] = samples_->size();
+      samples_->push_back(sample);
+      liveSampleCount_ = liveSamples_->size();
+    }
+    unlock(&lock_);
+  }
+
+  static bool enabled_;
+  static int64_t interval_;
+  static uint32_t generation_;
+  static KStdVector<Sample>* samples_;
+  // Index in samples_ of every sampled container not freed yet.
+  static KStdUnorderedMap<ContainerHeader*, size_t>* liveSamples_;
+  static size_t liveSampleCount_;
+  static KInt lock_;
+};
+
+bool AllocationProfiler::enabled_ = false;
+int64_t AllocationProfiler::interval_ = 0;
+uint32_t AllocationProfiler::generation_ = 0;
+KStdVector<AllocationProfiler::Sample>* AllocationProfiler::samples_ = nullptr;
+KStdUnorderedMap<ContainerHeader*, size_t>* AllocationProfiler::liveSamples_ = nullptr;
+size_t AllocationProfiler::liveSampleCount_ = 0;
+KInt AllocationProfiler::lock_ = 0;
+#endif  // USE_ALLOCATION_PROFILER
 
 #if COLLECT_STATISTIC
+// Whether memory manager events are counted, see GC.collectStatistic.
+bool memoryStatisticEnabled = false;
+
 class MemoryStatistic {
 public:
+  // Number of container and object kinds, see toIndex().
+  static constexpr int kKinds = 6;
+  // Number of allocation size histogram buckets, bucket i counts sizes in [2^i, 2^(i+1)).
+  static constexpr int kSizeBuckets = 32;
+  // Size of the snapshot passed to GC.statistic(), keep in sync with MemoryStatistic in GC.kt.
+  static constexpr int kSnapshotSize = kKinds * kKinds + kKinds * 4 + kSizeBuckets + 7;
+
   // UpdateRef per-object type counters.
-  uint64_t updateCounters[5][5];
-  // Alloc per container type counters.
-  uint64_t containerAllocs[5][2];
-  // Free per container type counters.
-  uint64_t objectAllocs[5][2];
+  uint64_t updateCounters[kKinds][kKinds];
+  // Alloc and free per container type counters.
+  uint64_t containerAllocs[kKinds][2];
+  // Alloc and free per object type counters.
+  uint64_t objectAllocs[kKinds][2];
   // Histogram of allocation size distribution.
-  KStdUnorderedMap<int, int>* allocationHistogram;
-  // Number of allocation cache hits.
-  int allocCacheHit;
-  // Number of allocation cache misses.
-  int allocCacheMiss;
+  uint64_t allocationHistogram[kSizeBuckets];
   // Number of regular reference increments.
   uint64_t addRefs;
   // Number of atomic reference increments.
@@ -123,24 +709,20 @@ public:
   uint64_t atomicReleaseRefs;
   // Number of potential cycle candidates.
   uint64_t releaseCyclicRefs;
+  // Number of garbage collections.
+  uint64_t gcRuns;
+  // Bytes of released containers.
+  uint64_t freedBytes;
 
   // Map of array index to human readable name.
   static constexpr const char* indexToName[] = {
-    "normal", "stack ", "perm  ", "frozen", "null  " };
+    "normal", "stack ", "perm  ", "frozen", "atomic", "null  " };
 
   void init() {
-    memset(containerAllocs, 0, sizeof(containerAllocs));
-    memset(objectAllocs, 0, sizeof(objectAllocs));
-    memset(updateCounters, 0, sizeof(updateCounters));
-    allocationHistogram = konanConstructInstance<KStdUnorderedMap<int, int>>();
-    allocCacheHit = 0;
-    allocCacheMiss = 0;
+    memset(this, 0, sizeof(*this));
   }
 
-  void deinit() {
-    konanDestructInstance(allocationHistogram);
-    allocationHistogram = nullptr;
-  }
+  void deinit() {}
 
   void incAddRef(const ContainerHeader* header, bool atomic) {
     if (atomic) atomicAddRefs++; else addRefs++;
@@ -161,7 +743,7 @@ public:
 
   void incAlloc(size_t size, const ContainerHeader* header) {
     containerAllocs[toIndex(header)][0]++;
-    ++(*allocationHistogram)[size];
+    allocationHistogram[toBucket(size)]++;
   }
 
   void incFree(const ContainerHeader* header) {
@@ -176,11 +758,60 @@ public:
     objectAllocs[toIndex(header)][1]++;
   }
 
+  void incGc() {
+    gcRuns++;
+  }
+
+  void incFreedBytes(size_t size) {
+    freedBytes += size;
+  }
+
+  void add(const MemoryStatistic& other) {
+    for (int i = 0; i < kKinds; i++) {
+      for (int j = 0; j < kKinds; j++)
+        updateCounters[i][j] += other.updateCounters[i][j];
+      for (int j = 0; j < 2; j++) {
+        containerAllocs[i][j] += other.containerAllocs[i][j];
+        objectAllocs[i][j] += other.objectAllocs[i][j];
+      }
+    }
+    for (int i = 0; i < kSizeBuckets; i++)
+      allocationHistogram[i] += other.allocationHistogram[i];
+    addRefs += other.addRefs;
+    atomicAddRefs += other.atomicAddRefs;
+    releaseRefs += other.releaseRefs;
+    atomicReleaseRefs += other.atomicReleaseRefs;
+    releaseCyclicRefs += other.releaseCyclicRefs;
+    gcRuns += other.gcRuns;
+    freedBytes += other.freedBytes;
+  }
+
+  void snapshot(KLong* result) const {
+    for (int i = 0; i < kKinds; i++)
+      for (int j = 0; j < kKinds; j++)
+        *result++ = updateCounters[i][j];
+    for (int i = 0; i < kKinds; i++) {
+      *result++ = containerAllocs[i][0];
+      *result++ = containerAllocs[i][1];
+      *result++ = objectAllocs[i][0];
+      *result++ = objectAllocs[i][1];
+    }
+    for (int i = 0; i < kSizeBuckets; i++)
+      *result++ = allocationHistogram[i];
+    *result++ = addRefs;
+    *result++ = atomicAddRefs;
+    *result++ = releaseRefs;
+    *result++ = atomicReleaseRefs;
+    *result++ = releaseCyclicRefs;
+    *result++ = gcRuns;
+    *result++ = freedBytes;
+  }
+
   static int toIndex(const ObjHeader* obj) {
     if (reinterpret_cast<uintptr_t>(obj) > 1)
         return toIndex(obj->container());
     else
-        return 4;
+        return 5;
   }
 
   static int toIndex(const ContainerHeader* header) {
@@ -189,11 +820,21 @@ public:
       case CONTAINER_TAG_NORMAL   : return 0;
       case CONTAINER_TAG_STACK    : return 1;
       case CONTAINER_TAG_FROZEN:    return 3;
+      case CONTAINER_TAG_ATOMIC:    return 4;
     }
     RuntimeAssert(false, "unknown container type");
     return -1;
   }
 
+  static int toBucket(size_t size) {
+    int bucket = 0;
+    while (size > 1 && bucket < kSizeBuckets - 1) {
+      size >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+
   static double percents(uint64_t value, uint64_t all) {
    return ((double)value / (double)all) * 100.0;
   }
@@ -212,8 +853,8 @@ public:
     }
 
     konan::consolePrintf("\n");
-    for (int i = 0; i < 5; i++) {
-      for (int j = 0; j < 5; j++) {
+    for (int i = 0; i < kKinds; i++) {
+      for (int j = 0; j < kKinds; j++) {
         konan::consolePrintf("UpdateRef[%s -> %s]: %lld\n",
                              indexToName[i], indexToName[j], updateCounters[i][j]);
       }
@@ -221,15 +862,10 @@ public:
     konan::consolePrintf("\n");
 
     konan::consolePrintf("Allocation histogram:\n");
-    KStdVector<int> keys(allocationHistogram->size());
-    int index = 0;
-    for (auto& it : *allocationHistogram) {
-      keys[index++] = it.first;
-    }
-    std::sort(keys.begin(), keys.end());
-    for (auto* it : keys) {
+    for (int i = 0; i < kSizeBuckets; i++) {
+      if (allocationHistogram[i] == 0) continue;
       konan::consolePrintf(
-          "%d bytes -> %d times\n", it, (*allocationHistogram)[it]);
+          "%lld bytes and more -> %lld times\n", 1LL << i, allocationHistogram[i]);
     }
 
     uint64_t allAddRefs = addRefs + atomicAddRefs;
@@ -240,13 +876,435 @@ public:
                          addRefs, atomicAddRefs, percents(atomicAddRefs, allAddRefs),
                          releaseRefs, atomicReleaseRefs, percents(atomicAddRefs, allReleases),
                          releaseCyclicRefs, percents(releaseCyclicRefs, allReleases));
+    konan::consolePrintf("GC runs: %lld, freed: %lld bytes\n", gcRuns, freedBytes);
+#if USE_LARGE_OBJECT_SPACE
+    konan::consolePrintf("Large objects: %lld, %lld bytes\n",
+                         static_cast<long long>(LargeObjectSpace::count()),
+                         static_cast<long long>(LargeObjectSpace::bytes()));
+#endif
   }
 };
 
 constexpr const char* MemoryStatistic::indexToName[];
 
+// Statistic of already finished workers.
+MemoryStatistic finishedWorkersStatistic;
+KInt finishedWorkersStatisticLock = 0;
+
 #endif  // COLLECT_STATISTIC
 
+#if USE_SIZE_CLASS_ALLOCATOR
+// Segregated-fit allocator for small containers. Every memory state owns an instance, so allocation
+// and freeing work on thread-local free lists without any synchronization. Blocks are carved from
+// chunks shared by all size classes. Chunks are aligned to their size, so the chunk of a block is
+// known from its address, and count blocks handed out by the owning allocator and not given back to it.
+// As frozen containers could be freed by other thread, than one which allocated them, such blocks go
+// to the free lists of the freeing allocator, and stay counted in the chunk, which is thus never returned.
+// Chunks without blocks in use are returned to the system by trim(), and when memory state dies,
+// its remaining chunks and free lists are moved to the global depot and adopted by the next memory state.
+class SizeClassAllocator {
+ public:
+  void init() {
+    lock(&depotLock_);
+    adopt(&depot_);
+    unlock(&depotLock_);
+  }
+
+  void deinit() {
+    // Leftover of the current chunk is kept as free blocks, so that it is not lost.
+    while (current_ + 2 * kObjectAlignment <= end_) {
+      size_t size = end_ - current_;
+      if (!isSmallSize(size)) size = kMaxSizeClassSize;
+      push(sizeClassOf(size), current_);
+      current_ += size;
+    }
+    current_ = end_ = nullptr;
+    currentChunk_ = nullptr;
+    trim();
+    lock(&depotLock_);
+    depot_.adopt(this);
+    unlock(&depotLock_);
+  }
+
+  // Returns block of the given size, which must be aligned to kObjectAlignment.
+  // Block is zero-initialized, unless zeroed is false.
+  void* alloc(size_t size, bool zeroed) {
+    int index = sizeClassOf(size);
+    FreeBlock* block = freeLists_[index];
+    if (block != nullptr) {
+      freeLists_[index] = block->next;
+      Chunk* chunk = chunkOf(block);
+      if (chunk->owner == this) chunk->used++;
+      if (zeroed) memset(block, 0, size);
+      return block;
+    }
+    if (current_ + size > end_ && !allocChunk()) return nullptr;
+    // Chunk memory is zeroed by konan::callocAligned() and never reused for anything but free blocks.
+    void* result = current_;
+    current_ += size;
+    currentChunk_->used++;
+    return result;
+  }
+
+  void free(void* block, int sizeClass) {
+    Chunk* chunk = chunkOf(block);
+    if (chunk->owner == this) chunk->used--;
+    push(sizeClass, block);
+  }
+
+  // Frees block on a thread without memory state, the next initialized allocator takes it over.
+  static void freeToDepot(void* block, int sizeClass) {
+    lock(&depotLock_);
+    depot_.free(block, sizeClass);
+    unlock(&depotLock_);
+  }
+
+  // Returns chunks without blocks in use, but the current one, to the system.
+  void trim() {
+    int released = 0;
+    for (Chunk* chunk = chunks_; chunk != nullptr; chunk = chunk->next) {
+      if (chunk->used == 0 && chunk != currentChunk_) {
+        chunk->used = kReleasedChunk;
+        released++;
+      }
+    }
+    if (released == 0) return;
+    // Blocks of chunks owned by other allocators are in use from their point of view, so these chunks stay alive.
+    for (int index = 0; index < kSizeClassCount; index++) {
+      FreeBlock** link = &freeLists_[index];
+      while (*link != nullptr) {
+        Chunk* chunk = chunkOf(*link);
+        if (chunk->owner == this && chunk->used == kReleasedChunk)
+          *link = (*link)->next;
+        else
+          link = &(*link)->next;
+      }
+    }
+    Chunk** link = &chunks_;
+    while (*link != nullptr) {
+      Chunk* chunk = *link;
+      if (chunk->used == kReleasedChunk) {
+        *link = chunk->next;
+        konan::freeAligned(chunk);
+        chunkCount_--;
+      } else {
+        link = &chunk->next;
+      }
+    }
+  }
+
+  // Bytes of chunks owned by this allocator.
+  size_t reservedBytes() const {
+    return chunkCount_ * kSizeClassChunkSize;
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  struct alignas(8) Chunk {
+    Chunk* next;
+    SizeClassAllocator* owner;
+    // Blocks handed out by the owner, and not freed to it yet.
+    int32_t used;
+  };
+
+  // Marks chunks being returned to the system by trim().
+  static constexpr int32_t kReleasedChunk = -1;
+
+  static Chunk* chunkOf(void* block) {
+    return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(block) & ~(kSizeClassChunkSize - 1));
+  }
+
+  void push(int sizeClass, void* memory) {
+    auto* block = reinterpret_cast<FreeBlock*>(memory);
+    block->next = freeLists_[sizeClass];
+    freeLists_[sizeClass] = block;
+  }
+
+  bool allocChunk() {
+    auto* chunk = reinterpret_cast<Chunk*>(konan::callocAligned(kSizeClassChunkSize, kSizeClassChunkSize));
+    if (chunk == nullptr) return false;
+    retireTail();
+    chunk->next = chunks_;
+    chunk->owner = this;
+    chunks_ = chunk;
+    chunkCount_++;
+    currentChunk_ = chunk;
+    current_ = reinterpret_cast<uint8_t*>(chunk + 1);
+    end_ = reinterpret_cast<uint8_t*>(chunk) + kSizeClassChunkSize;
+    return true;
+  }
+
+  // Keeps what is left from the current chunk in the free list of the matching size class.
+  void retireTail() {
+    if (current_ + 2 * kObjectAlignment <= end_)
+      push(sizeClassOf(end_ - current_), current_);
+  }
+
+  // Moves all free blocks and chunks from the other allocator to this one.
+  void adopt(SizeClassAllocator* other) {
+    for (int index = 0; index < kSizeClassCount; index++) {
+      FreeBlock* list = other->freeLists_[index];
+      if (list == nullptr) continue;
+      FreeBlock* last = list;
+      while (last->next != nullptr) last = last->next;
+      last->next = freeLists_[index];
+      freeLists_[index] = list;
+      other->freeLists_[index] = nullptr;
+    }
+    if (other->chunks_ != nullptr) {
+      Chunk* last = other->chunks_;
+      last->owner = this;
+      while (last->next != nullptr) {
+        last = last->next;
+        last->owner = this;
+      }
+      last->next = chunks_;
+      chunks_ = other->chunks_;
+      other->chunks_ = nullptr;
+      chunkCount_ += other->chunkCount_;
+      other->chunkCount_ = 0;
+    }
+  }
+
+  FreeBlock* freeLists_[kSizeClassCount];
+  Chunk* chunks_;
+  size_t chunkCount_;
+  Chunk* currentChunk_;
+  uint8_t* current_;
+  uint8_t* end_;
+
+  static SizeClassAllocator depot_;
+  static KInt depotLock_;
+};
+
+constexpr int32_t SizeClassAllocator::kReleasedChunk;
+SizeClassAllocator SizeClassAllocator::depot_;
+KInt SizeClassAllocator::depotLock_ = 0;
+#endif  // USE_SIZE_CLASS_ALLOCATOR
+
+#if USE_SCRATCH_ARENA
+// Bump allocator for temporary STL containers of GC, freezing and subgraph transfer, see ScratchScope.
+// Memory is released at once when the outermost scope is left. Meanwhile freed blocks are recycled
+// by power of two size classes, so that containers growing and shrinking during traversal reuse memory.
+class ScratchArena {
+ public:
+  void* allocate(size_t size) {
+    RuntimeAssert(depth_ > 0, "Scratch memory must be allocated in scope");
+    int sizeClass = sizeClassOf(size);
+    if (freeLists_[sizeClass] != nullptr) {
+      auto* block = freeLists_[sizeClass];
+      freeLists_[sizeClass] = block->next;
+      return block;
+    }
+    size_t blockSize = static_cast<size_t>(1) << sizeClass;
+    if (current_ + blockSize > end_) addChunk(blockSize);
+    void* result = current_;
+    current_ += blockSize;
+    return result;
+  }
+
+  void deallocate(void* pointer, size_t size) {
+    if (pointer == nullptr) return;
+    int sizeClass = sizeClassOf(size);
+    auto* block = reinterpret_cast<FreeBlock*>(pointer);
+    block->next = freeLists_[sizeClass];
+    freeLists_[sizeClass] = block;
+  }
+
+  void enter() {
+    depth_++;
+  }
+
+  void leave() {
+    if (--depth_ == 0) reset();
+  }
+
+  void deinit() {
+    RuntimeAssert(depth_ == 0, "Scratch arena is in use");
+    reset();
+    freeChunks(chunks_);
+    chunks_ = nullptr;
+    current_ = end_ = nullptr;
+  }
+
+ private:
+  struct Chunk {
+    Chunk* next;
+    size_t size;
+
+    uint8_t* data() {
+      return reinterpret_cast<uint8_t*>(this + 1);
+    }
+  };
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static constexpr int kMinSizeClass = 4;
+  static constexpr int kSizeClassCount = 64;
+
+  static int sizeClassOf(size_t size) {
+    int sizeClass = kMinSizeClass;
+    while ((static_cast<size_t>(1) << sizeClass) < size) sizeClass++;
+    return sizeClass;
+  }
+
+  void addChunk(size_t minSize) {
+    // Chunks grow, so that O(log(size)) chunks are allocated for the peak size of temporaries.
+    size_t size = chunks_ == nullptr ? kScratchChunkSize : chunks_->size * 2;
+    if (size > kMaxScratchChunkSize) size = kMaxScratchChunkSize;
+    if (size < minSize) size = minSize;
+    auto* chunk = reinterpret_cast<Chunk*>(konanAllocUninitializedMemory(sizeof(Chunk) + size));
+    RuntimeCheck(chunk != nullptr, "Cannot alloc scratch memory");
+    chunk->next = chunks_;
+    chunk->size = size;
+    chunks_ = chunk;
+    current_ = chunk->data();
+    end_ = current_ + size;
+  }
+
+  static void freeChunks(Chunk* chunk) {
+    while (chunk != nullptr) {
+      auto* next = chunk->next;
+      konanFreeMemory(chunk);
+      chunk = next;
+    }
+  }
+
+  // Keeps only the last chunk, which is the largest one, for the next use, unless it is too large.
+  void reset() {
+    memset(freeLists_, 0, sizeof(freeLists_));
+    if (chunks_ == nullptr) return;
+    freeChunks(chunks_->next);
+    chunks_->next = nullptr;
+    if (chunks_->size > kMaxScratchChunkSize) {
+      freeChunks(chunks_);
+      chunks_ = nullptr;
+      current_ = end_ = nullptr;
+      return;
+    }
+    current_ = chunks_->data();
+    end_ = current_ + chunks_->size;
+  }
+
+  FreeBlock* freeLists_[kSizeClassCount];
+  Chunk* chunks_;
+  uint8_t* current_;
+  uint8_t* end_;
+  int depth_;
+};
+#endif  // USE_SCRATCH_ARENA
+
+#if USE_WRITE_LOG
+// Heap stores, whose reference counting is deferred till FlushWriteLog(). Only the first store to a location
+// is recorded, along with the value it overwrote, so that repeated stores to the same location cost
+// a single increment of the last stored value and decrement of the overwritten one.
+// Logged locations could refer to containers whose count is zero, so such containers are also recorded,
+// and freed once the log is flushed, unless logged stores refer to them.
+class WriteLog {
+ public:
+  struct Entry {
+    ObjHeader** location;
+    ObjHeader* old;
+  };
+
+  // Returns false if location is not logged yet, and there is no room for it.
+  bool record(ObjHeader** location, ObjHeader* old) {
+    int slot = find(location);
+    if (index_[slot] != 0) return true;
+    if (size_ == kWriteLogSize) return false;
+    entries_[size_] = { location, old };
+    index_[slot] = ++size_;
+    return true;
+  }
+
+  // Returns false if there is no room for container. Container could be recorded more than once.
+  bool recordZeroCount(ContainerHeader* container) {
+    if (zeroCountSize_ == kWriteLogZeroCountSize) return false;
+    zeroCount_[zeroCountSize_++] = container;
+    return true;
+  }
+
+  bool contains(ObjHeader** location) const {
+    return index_[find(location)] != 0;
+  }
+
+  int size() const {
+    return size_;
+  }
+
+  // Moves entries to buffer, which shall fit kWriteLogSize entries, and returns their number.
+  int drain(Entry* buffer) {
+    int size = size_;
+    memcpy(buffer, entries_, size * sizeof(Entry));
+    memset(index_, 0, sizeof(index_));
+    size_ = 0;
+    return size;
+  }
+
+  // Moves recorded containers to buffer, which shall fit kWriteLogZeroCountSize entries, and returns their number.
+  int drainZeroCount(ContainerHeader** buffer) {
+    int size = zeroCountSize_;
+    memcpy(buffer, zeroCount_, size * sizeof(ContainerHeader*));
+    zeroCountSize_ = 0;
+    return size;
+  }
+
+ private:
+  // Linear probing, terminates as the index is never more than half full.
+  int find(ObjHeader** location) const {
+    uint32_t hash = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(location) / sizeof(ObjHeader*)) * 2654435761u;
+    int slot = hash >> (32 - kWriteLogIndexBits);
+    while (index_[slot] != 0 && entries_[index_[slot] - 1].location != location)
+      slot = (slot + 1) & (kWriteLogIndexSize - 1);
+    return slot;
+  }
+
+  Entry entries_[kWriteLogSize];
+  // Entry number plus one for occupied slots, zero for empty ones.
+  uint8_t index_[kWriteLogIndexSize];
+  int size_;
+  ContainerHeader* zeroCount_[kWriteLogZeroCountSize];
+  int zeroCountSize_;
+};
+#endif  // USE_WRITE_LOG
+
+#if USE_BIASED_RC
+// References from stack roots of the worker to shareable containers. Worker takes a single atomic reference
+// to the cached container, counts references from its stack in the cache, and returns the atomic reference
+// once they are gone, unless the container is still referenced elsewhere. Heap references could be released by
+// other workers, so they are always counted atomically.
+class SharedRefCache {
+ public:
+  struct Entry {
+    ContainerHeader* container;
+    // References from the stack, the atomic reference is held while container is cached, even if it is zero.
+    int count;
+  };
+
+  // Direct mapped, entry could be in use by another container.
+  Entry* entryFor(ContainerHeader* container) {
+    uint32_t hash = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(container) / kObjectAlignment) * 2654435761u;
+    return &entries_[hash >> (32 - kSharedRefCacheBits)];
+  }
+
+  Entry* begin() {
+    return entries_;
+  }
+
+  Entry* end() {
+    return entries_ + kSharedRefCacheSize;
+  }
+
+ private:
+  Entry entries_[kSharedRefCacheSize];
+};
+#endif  // USE_BIASED_RC
+
 struct MemoryState {
 #if TRACE_MEMORY
   // Set of all containers.
@@ -254,8 +1312,9 @@ struct MemoryState {
 #endif
 
 #if USE_GC
-  // Finalizer queue - linked list of containers scheduled for finalization.
-  ContainerHeader* finalizerQueue;
+  // Finalizer queue - linked lists of containers scheduled for finalization, binned by size class,
+  // so that AllocContainer() could reuse them. Bin 0 keeps containers too large to be reused.
+  ContainerHeader* finalizerQueue[kSizeClassCount];
   int finalizerQueueSize;
   int finalizerQueueSuspendCount;
   /*
@@ -274,6 +1333,13 @@ struct MemoryState {
   size_t gcThreshold;
   // If collection is in progress.
   bool gcInProgress;
+#if USE_DEFERRED_STACK_RC
+  // Thread-local containers without counted references, which could still be referenced from stack roots.
+  // Kept separately from toFree, as it is also used while GC is stopped.
+  ContainerHeaderList* zeroCount;
+  // Containers of zeroCount put back by StackRefsScope, these do not bring the next collection closer.
+  size_t zeroCountKept;
+#endif
 
 #if GC_ERGONOMICS
   uint64_t lastGcTimestamp;
@@ -281,27 +1347,101 @@ struct MemoryState {
 
 #endif // USE_GC
 
+#if USE_SIZE_CLASS_ALLOCATOR
+  SizeClassAllocator allocator;
+#endif
+
+#if USE_SCRATCH_ARENA
+  ScratchArena scratch;
+#endif
+
+#if USE_WRITE_LOG
+  WriteLog writeLog;
+#endif
+
+#if USE_BIASED_RC
+  SharedRefCache sharedRefs;
+#endif
+
+#if USE_DEFERRED_STACK_RC
+  // The innermost frame with object slots of this thread, see EnterFrame().
+  FrameOverlay* currentFrame;
+#endif
+
+  // Bytes of containers returned to malloc heap since the last TrimMemory().
+  size_t heapBytesFreed;
+
+#if USE_BACKGROUND_FREE
+  // Batch of released containers not yet handed to the background freeing thread.
+  ContainerHeader* backgroundFreeFirst;
+  ContainerHeader* backgroundFreeLast;
+  int backgroundFreeCount;
+#endif
+
+  // Number of containers allocated minus number of containers released by this worker. Counted per worker,
+  // so that workers do not contend on a shared counter, and summed once the last worker terminates.
+  int allocCount;
+
+  // Bytes of heap containers allocated by this worker and not yet released. Containers are
+  // accounted to the worker releasing them, so it is only approximate for objects passed
+  // between workers.
+  int64_t heapUsed;
+  // Limit for heapUsed, zero if unlimited, see GC.heapQuota.
+  int64_t heapQuota;
+  // Set while OutOfMemoryError for exceeded quota is being thrown.
+  bool heapQuotaSuspended;
+
+  // Memory pressure level last observed by this worker, see CheckMemoryPressure().
+  MemoryPressureLevel memoryPressureLevel;
+  // Memory pressure level listeners were last notified about, see DeliverMemoryPressure().
+  MemoryPressureLevel notifiedMemoryPressureLevel;
+  // Bytes to allocate before memory pressure is checked again.
+  int64_t bytesUntilMemoryPressureCheck;
+  // Set while memory pressure listeners are running.
+  bool memoryPressureNotifying;
+#if USE_GC
+  // GC threshold to restore once memory pressure is gone.
+  size_t normalGcThreshold;
+#endif
+
+#if USE_ALLOCATION_PROFILER
+  AllocationProfiler::Sampler allocationSampler;
+#endif
+
+  // LIFO cache of arena chunks released by LeaveFrame(), linked via ContainerChunk::next.
+  ContainerChunk* arenaChunkCache;
+  // Total size of chunks in the cache.
+  size_t arenaChunkCacheSize;
+
 #if COLLECT_STATISTIC
-  #define CONTAINER_ALLOC_STAT(state, size, container) state->statistic.incAlloc(size, container);
+  #define CONTAINER_ALLOC_STAT(state, size, container) \
+    if (memoryStatisticEnabled) state->statistic.incAlloc(size, container);
   #define CONTAINER_FREE_STAT(state, container)
   #define CONTAINER_DESTROY_STAT(state, container) \
-    state->statistic.incFree(container);
+    if (memoryStatisticEnabled) state->statistic.incFree(container);
   #define OBJECT_ALLOC_STAT(state, size, object) \
-    state->statistic.incAlloc(size, object);
+    if (memoryStatisticEnabled) state->statistic.incAlloc(size, object);
   #define OBJECT_FREE_STAT(state, size, object) \
-    state->statistic.incFree(object);
+    if (memoryStatisticEnabled) state->statistic.incFree(object);
   #define UPDATE_REF_STAT(state, oldRef, newRef, slot) \
-    state->statistic.incUpdateRef(oldRef, newRef);
+    if (memoryStatisticEnabled) state->statistic.incUpdateRef(oldRef, newRef);
   #define UPDATE_ADDREF_STAT(state, obj, atomic) \
-      state->statistic.incAddRef(obj, atomic);
+    if (memoryStatisticEnabled) state->statistic.incAddRef(obj, atomic);
   #define UPDATE_RELEASEREF_STAT(state, obj, atomic, cyclic) \
-        state->statistic.incReleaseRef(obj, atomic, cyclic);
+    if (memoryStatisticEnabled) state->statistic.incReleaseRef(obj, atomic, cyclic);
+  #define GC_STAT(state) \
+    if (memoryStatisticEnabled) state->statistic.incGc();
+  #define RELEASE_MEMORY_STAT(state, size) \
+    if (memoryStatisticEnabled) state->statistic.incFreedBytes(size);
   #define INIT_STAT(state) \
     state->statistic.init();
   #define DEINIT_STAT(state) \
+    lock(&finishedWorkersStatisticLock); \
+    finishedWorkersStatistic.add(state->statistic); \
+    unlock(&finishedWorkersStatisticLock); \
     state->statistic.deinit();
   #define PRINT_STAT(state) \
-    state->statistic.printStatistic();
+    if (memoryStatisticEnabled) state->statistic.printStatistic();
   MemoryStatistic statistic;
 #else
   #define CONTAINER_ALLOC_STAT(state, size, container)
@@ -312,6 +1452,8 @@ struct MemoryState {
   #define UPDATE_REF_STAT(state, oldRef, newRef, slot)
   #define UPDATE_ADDREF_STAT(state, obj, atomic)
   #define UPDATE_RELEASEREF_STAT(state, obj, atomic, cyclic)
+  #define GC_STAT(state)
+  #define RELEASE_MEMORY_STAT(state, size)
   #define INIT_STAT(state)
   #define DEINIT_STAT(state)
   #define PRINT_STAT(state)
@@ -379,11 +1521,105 @@ struct MemoryState {
 
 namespace {
 
-// TODO: can we pass this variable as an explicit argument?
+// Thread-local access could be costly, e.g. via __tls_get_addr() when the runtime is a shared library,
+// so hot paths read it once per entry point and pass the state explicitly.
 THREAD_LOCAL_VARIABLE MemoryState* memoryState = nullptr;
 
 constexpr int kFrameOverlaySlots = sizeof(FrameOverlay) / sizeof(ObjHeader**);
 
+#if USE_SCRATCH_ARENA
+// Allocates from scratch arena of the current worker, so containers using it must not outlive ScratchScope.
+template <class T> class ScratchAllocator {
+ public:
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef T value_type;
+
+  ScratchAllocator() {}
+  ScratchAllocator(const ScratchAllocator&) {}
+
+  pointer allocate(size_type n, const void * = 0) {
+    return reinterpret_cast<T*>(memoryState->scratch.allocate(n * sizeof(T)));
+  }
+
+  void deallocate(void* p, size_type n) {
+    memoryState->scratch.deallocate(p, n * sizeof(T));
+  }
+
+  pointer address(reference x) const { return &x; }
+
+  const_pointer address(const_reference x) const { return &x; }
+
+  ScratchAllocator<T>& operator=(const ScratchAllocator&) { return *this; }
+
+  void construct(pointer p, const T& val) { new ((T*) p) T(val); }
+
+  template <class U, class ...A>
+  void construct(U* const p, A&& ...args) {
+    new (p) U(::std::forward<A>(args)...);
+  }
+
+  void destroy(pointer p) { p->~T(); }
+
+  size_type max_size() const { return size_t(-1); }
+
+  template <class U>
+  struct rebind { typedef ScratchAllocator<U> other; };
+
+  template <class U>
+  ScratchAllocator(const ScratchAllocator<U>&) {}
+
+  template <class U>
+  ScratchAllocator& operator=(const ScratchAllocator<U>&) { return *this; }
+};
+
+template <class T, class U>
+bool operator==(ScratchAllocator<T> const&, ScratchAllocator<U> const&) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(ScratchAllocator<T> const& x, ScratchAllocator<U> const& y) noexcept {
+  return !(x == y);
+}
+
+// Scratch memory allocated within the scope is released once the outermost scope is left.
+class ScratchScope {
+ public:
+  ScratchScope() {
+    memoryState->scratch.enter();
+  }
+
+  ~ScratchScope() {
+    memoryState->scratch.leave();
+  }
+};
+#else
+template <class T>
+using ScratchAllocator = KonanAllocator<T>;
+
+class ScratchScope {};
+#endif  // USE_SCRATCH_ARENA
+
+template<class Value>
+using ScratchDeque = std::deque<Value, ScratchAllocator<Value>>;
+template<class Key, class Value>
+using ScratchUnorderedMap = std::unordered_map<Key, Value,
+  std::hash<Key>, std::equal_to<Key>,
+  ScratchAllocator<std::pair<const Key, Value>>>;
+template<class Value>
+using ScratchUnorderedSet = std::unordered_set<Value,
+  std::hash<Value>, std::equal_to<Value>,
+  ScratchAllocator<Value>>;
+template<class Value>
+using ScratchVector = std::vector<Value, ScratchAllocator<Value>>;
+
+typedef ScratchDeque<ContainerHeader*> ContainerHeaderDeque;
+
 inline bool isFreeable(const ContainerHeader* header) {
   return header != nullptr && header->tag() != CONTAINER_TAG_STACK;
 }
@@ -396,7 +1632,7 @@ inline bool isAggregatingFrozenContainer(const ContainerHeader* header) {
   return header != nullptr && header->frozen() && header->objectCount() > 1;
 }
 
-inline container_size_t alignUp(container_size_t size, int alignment) {
+constexpr container_size_t alignUp(container_size_t size, int alignment) {
   return (size + alignment - 1) & ~(alignment - 1);
 }
 
@@ -422,6 +1658,65 @@ inline container_size_t objectSize(const ObjHeader* obj) {
   return alignUp(size, kObjectAlignment);
 }
 
+// Takes the most recently cached arena chunk able to fit given size, if any.
+ContainerChunk* takeCachedArenaChunk(MemoryState* state, container_size_t size) {
+  ContainerChunk** location = &state->arenaChunkCache;
+  while (*location != nullptr) {
+    ContainerChunk* chunk = *location;
+    if (chunk->size >= size) {
+      *location = chunk->next;
+      container_size_t size = chunk->size;
+      state->arenaChunkCacheSize -= size;
+      // Arena objects expect zeroed memory.
+      memset(chunk, 0, size);
+      chunk->size = size;
+      return chunk;
+    }
+    location = &chunk->next;
+  }
+  return nullptr;
+}
+
+void releaseArenaChunk(MemoryState* state, ContainerChunk* chunk) {
+  if (chunk->size > kMaxCachedArenaChunkSize ||
+      state->arenaChunkCacheSize + chunk->size > kMaxArenaChunkCacheSize) {
+    konanFreeMemory(chunk);
+    return;
+  }
+  chunk->next = state->arenaChunkCache;
+  state->arenaChunkCache = chunk;
+  state->arenaChunkCacheSize += chunk->size;
+}
+
+void clearArenaChunkCache(MemoryState* state) {
+  while (state->arenaChunkCache != nullptr) {
+    auto* chunk = state->arenaChunkCache;
+    state->arenaChunkCache = chunk->next;
+    konanFreeMemory(chunk);
+  }
+  state->arenaChunkCacheSize = 0;
+}
+
+inline size_t containerSize(const ContainerHeader* container) {
+  size_t result = 0;
+  const ObjHeader* obj = reinterpret_cast<const ObjHeader*>(container + 1);
+  for (int object = 0; object < container->objectCount(); object++) {
+    size_t size = objectSize(obj);
+    result += size;
+    obj = reinterpret_cast<ObjHeader*>(
+        reinterpret_cast<uintptr_t>(obj) + size);
+  }
+  return result;
+}
+
+// Size of the memory block allocated for the container by AllocContainer().
+// Must be called before the container is put to the finalizer queue, as it reads object headers.
+inline size_t containerAllocSize(const ContainerHeader* container) {
+  size_t bodySize = isAggregatingFrozenContainer(container) ?
+      sizeof(ContainerHeader*) * container->objectCount() : containerSize(container);
+  return alignUp(sizeof(ContainerHeader) + bodySize, kObjectAlignment);
+}
+
 inline bool isArenaSlot(ObjHeader** slot) {
   return (reinterpret_cast<uintptr_t>(slot) & ARENA_BIT) != 0;
 }
@@ -439,13 +1734,14 @@ inline bool isRefCounted(KConstRef object) {
   return isFreeable(object->container());
 }
 
-inline void lock(KInt* spinlock) {
-  while (compareAndSwap(spinlock, 0, 1) != 0) {}
-}
-
-inline void unlock(KInt* spinlock) {
-  RuntimeCheck(compareAndSwap(spinlock, 1, 0) == 1, "Must succeed");
+#if USE_WRITE_LOG
+// Only this worker could release objects which are not shareable, so their counting could be deferred.
+inline bool isThreadLocalRef(const ObjHeader* object) {
+  if (reinterpret_cast<uintptr_t>(object) <= 1) return true;
+  auto* container = object->container();
+  return container == nullptr || !container->shareable();
 }
+#endif
 
 } // namespace
 
@@ -474,9 +1770,15 @@ extern "C" {
 void objc_release(void* ptr);
 void Kotlin_ObjCExport_releaseAssociatedObject(void* associatedObject);
 RUNTIME_NORETURN void ThrowFreezingException(KRef toFreeze, KRef blocker);
+void OnMemoryPressure(KInt level);
+void ReportUnhandledException(KRef throwable);
 
 }  // extern "C"
 
+// Process-wide memory pressure limits in bytes, zero if not set, see GC.softMemoryLimit.
+size_t memoryPressureSoftLimit = 0;
+size_t memoryPressureHardLimit = 0;
+
 inline void runDeallocationHooks(ContainerHeader* container) {
   ObjHeader* obj = reinterpret_cast<ObjHeader*>(container + 1);
 
@@ -491,6 +1793,9 @@ inline void runDeallocationHooks(ContainerHeader* container) {
 }
 
 void DeinitInstanceBody(const TypeInfo* typeInfo, void* body) {
+#if USE_WRITE_LOG
+  FlushWriteLog(memoryState);
+#endif
   for (int index = 0; index < typeInfo->objOffsetsCount_; index++) {
     ObjHeader** location = reinterpret_cast<ObjHeader**>(
         reinterpret_cast<uintptr_t>(body) + typeInfo->objOffsets_[index]);
@@ -500,24 +1805,29 @@ void DeinitInstanceBody(const TypeInfo* typeInfo, void* body) {
 
 namespace {
 
+template<typename func>
+inline void traverseObjectFields(ObjHeader* obj, func process) {
+  const TypeInfo* typeInfo = obj->type_info();
+  if (typeInfo != theArrayTypeInfo) {
+    for (int index = 0; index < typeInfo->objOffsetsCount_; index++) {
+      ObjHeader** location = reinterpret_cast<ObjHeader**>(
+          reinterpret_cast<uintptr_t>(obj) + typeInfo->objOffsets_[index]);
+      process(location);
+    }
+  } else {
+    ArrayHeader* array = obj->array();
+    for (int index = 0; index < array->count_; index++) {
+      process(ArrayAddressOfElementAt(array, index));
+    }
+  }
+}
+
 template<typename func>
 inline void traverseContainerObjectFields(ContainerHeader* container, func process) {
   RuntimeAssert(!isAggregatingFrozenContainer(container), "Must not be called on such containers");
   ObjHeader* obj = reinterpret_cast<ObjHeader*>(container + 1);
   for (int object = 0; object < container->objectCount(); object++) {
-    const TypeInfo* typeInfo = obj->type_info();
-    if (typeInfo != theArrayTypeInfo) {
-      for (int index = 0; index < typeInfo->objOffsetsCount_; index++) {
-        ObjHeader** location = reinterpret_cast<ObjHeader**>(
-            reinterpret_cast<uintptr_t>(obj) + typeInfo->objOffsets_[index]);
-        process(location);
-      }
-    } else {
-      ArrayHeader* array = obj->array();
-      for (int index = 0; index < array->count_; index++) {
-        process(ArrayAddressOfElementAt(array, index));
-      }
-    }
+    traverseObjectFields(obj, process);
     obj = reinterpret_cast<ObjHeader*>(
       reinterpret_cast<uintptr_t>(obj) + objectSize(obj));
   }
@@ -531,6 +1841,166 @@ inline void traverseContainerReferredObjects(ContainerHeader* container, func pr
   });
 }
 
+#if USE_CONTAINER_REGISTRY
+// Registry of live heap containers of all workers, along with memory state of the worker allocated them.
+// Containers are registered once their objects are initialized, and unregistered when released,
+// so only ones allocated while registry is enabled are known. Registry also keeps per class counters
+// of registered objects. TypeInfo has no writable part on most platforms, so counters are kept aside.
+class ContainerRegistry {
+ public:
+  struct TypeCounters {
+    int64_t liveCount;
+    int64_t liveBytes;
+    int64_t allocCount;
+  };
+
+  static bool enabled() {
+    return enabled_;
+  }
+
+  static void setEnabled(bool enabled) {
+    lock(&lock_);
+    if (enabled && containers_ == nullptr) {
+      containers_ = konanConstructInstance<KStdUnorderedMap<ContainerHeader*, MemoryState*>>();
+      typeCounters_ = konanConstructInstance<KStdUnorderedMap<const TypeInfo*, TypeCounters>>();
+    }
+    if (!enabled && containers_ != nullptr) {
+      containers_->clear();
+      typeCounters_->clear();
+    }
+    enabled_ = enabled;
+    unlock(&lock_);
+  }
+
+  static void add(ContainerHeader* container, MemoryState* owner) {
+    lock(&lock_);
+    if (enabled_) {
+      (*containers_)[container] = owner;
+      countObjects(container, 1);
+    }
+    unlock(&lock_);
+  }
+
+  static void remove(ContainerHeader* container) {
+    lock(&lock_);
+    if (containers_ != nullptr && containers_->erase(container) != 0)
+      countObjects(container, -1);
+    unlock(&lock_);
+  }
+
+  // Copies counters of every class with registered objects allocated.
+  static void typeCounters(KStdVector<std::pair<const TypeInfo*, TypeCounters>>& result) {
+    lock(&lock_);
+    if (typeCounters_ != nullptr)
+      result.assign(typeCounters_->begin(), typeCounters_->end());
+    unlock(&lock_);
+  }
+
+  // Calls process for every registered container and reference to its owner. Note that registry is locked,
+  // so containers cannot be allocated or released by process, and other workers trying to do that wait.
+  template <typename func>
+  static void forEach(func process) {
+    lock(&lock_);
+    if (containers_ != nullptr) {
+      for (auto& entry : *containers_)
+        process(entry.first, entry.second);
+    }
+    unlock(&lock_);
+  }
+
+ private:
+  static void countObjects(ContainerHeader* container, int delta) {
+    ObjHeader* obj = reinterpret_cast<ObjHeader*>(container + 1);
+    for (int object = 0; object < container->objectCount(); object++) {
+      auto& counters = (*typeCounters_)[obj->type_info()];
+      counters.liveCount += delta;
+      counters.liveBytes += delta * static_cast<int64_t>(objectSize(obj));
+      if (delta > 0) counters.allocCount++;
+      obj = reinterpret_cast<ObjHeader*>(
+        reinterpret_cast<uintptr_t>(obj) + objectSize(obj));
+    }
+  }
+
+  static bool enabled_;
+  static KStdUnorderedMap<ContainerHeader*, MemoryState*>* containers_;
+  static KStdUnorderedMap<const TypeInfo*, TypeCounters>* typeCounters_;
+  static KInt lock_;
+};
+
+// Whether leaked containers are reported when worker or runtime is deinitialized, see GC.reportLeaks.
+bool leakReportEnabled = false;
+
+bool ContainerRegistry::enabled_ = false;
+KStdUnorderedMap<ContainerHeader*, MemoryState*>* ContainerRegistry::containers_ = nullptr;
+KStdUnorderedMap<const TypeInfo*, ContainerRegistry::TypeCounters>* ContainerRegistry::typeCounters_ = nullptr;
+KInt ContainerRegistry::lock_ = 0;
+#endif  // USE_CONTAINER_REGISTRY
+
+// Remembers how container memory shall be released, as object headers are no longer readable
+// once container is linked into the finalizer queue. Object count of a dead container is reused
+// to store its size class, zero means the container is too large to be recycled.
+inline int prepareContainerForRelease(MemoryState* state, ContainerHeader* container) {
+  size_t size = containerAllocSize(container);
+#if USE_ALLOCATION_PROFILER
+  if (AllocationProfiler::hasLiveSamples()) AllocationProfiler::released(container);
+#endif
+#if USE_CONTAINER_REGISTRY
+  if (ContainerRegistry::enabled()) ContainerRegistry::remove(container);
+#endif
+#if USE_LARGE_OBJECT_SPACE
+  if (isLargeObjectSize(size)) {
+    container->setObjectCount(kLargeObjectSizeClass);
+    state->heapUsed -= size;
+    RELEASE_MEMORY_STAT(state, size)
+    return 0;
+  }
+#endif
+  int sizeClass = isSmallSize(size) ? sizeClassOf(size) : 0;
+  container->setObjectCount(sizeClass);
+  state->heapUsed -= size;
+  RELEASE_MEMORY_STAT(state, size)
+#if USE_SIZE_CLASS_ALLOCATOR
+  if (sizeClass == 0)
+#endif
+  state->heapBytesFreed += size;
+  return sizeClass;
+}
+
+#if USE_BACKGROUND_FREE
+inline void flushBackgroundFree(MemoryState* state) {
+  if (state->backgroundFreeFirst == nullptr) return;
+  BackgroundFreer::submit(state->backgroundFreeFirst, state->backgroundFreeLast);
+  state->backgroundFreeFirst = state->backgroundFreeLast = nullptr;
+  state->backgroundFreeCount = 0;
+}
+#endif
+
+inline void releaseContainerMemory(MemoryState* state, ContainerHeader* container) {
+  int sizeClass = container->objectCount();
+#if USE_BACKGROUND_FREE
+  if (BackgroundFreer::enabled() && BackgroundFreer::accepts(sizeClass)) {
+    container->setNextLink(state->backgroundFreeFirst);
+    state->backgroundFreeFirst = container;
+    if (state->backgroundFreeLast == nullptr) state->backgroundFreeLast = container;
+    if (++state->backgroundFreeCount >= kBackgroundFreeBatchSize) flushBackgroundFree(state);
+    return;
+  }
+#endif
+#if USE_LARGE_OBJECT_SPACE
+  if (sizeClass == kLargeObjectSizeClass) {
+    LargeObjectSpace::free(container);
+    return;
+  }
+#endif
+#if USE_SIZE_CLASS_ALLOCATOR
+  if (sizeClass != 0) {
+    state->allocator.free(container, sizeClass);
+    return;
+  }
+#endif
+  konanFreeMemory(container);
+}
+
 #if USE_GC
 
 inline bool isMarkedAsRemoved(ContainerHeader* container) {
@@ -546,37 +2016,61 @@ inline ContainerHeader* clearRemoved(ContainerHeader* container) {
     reinterpret_cast<uintptr_t>(container) & ~static_cast<uintptr_t>(1));
 }
 
-inline void processFinalizerQueue(MemoryState* state) {
-  // TODO: reuse elements of finalizer queue for new allocations.
-  while (state->finalizerQueue != nullptr) {
-    auto* container = state->finalizerQueue;
-    state->finalizerQueue = container->nextLink();
-    state->finalizerQueueSize--;
+inline ContainerHeader* popFinalizerQueue(MemoryState* state, int sizeClass) {
+  auto* container = state->finalizerQueue[sizeClass];
+  state->finalizerQueue[sizeClass] = container->nextLink();
+  state->finalizerQueueSize--;
 #if TRACE_MEMORY
-    state->containers->erase(container);
+  state->containers->erase(container);
 #endif
-    CONTAINER_DESTROY_EVENT(state, container)
-    konanFreeMemory(container);
-    atomicAdd(&allocCount, -1);
+  CONTAINER_DESTROY_EVENT(state, container)
+  state->allocCount--;
+  return container;
+}
+
+inline bool canProcessFinalizerQueue(MemoryState* state) {
+  // We cannot touch finalizer queue while in GC, as containers there could still be visited.
+  return !state->gcInProgress && state->finalizerQueueSuspendCount == 0;
+}
+
+inline void processFinalizerQueue(MemoryState* state) {
+  for (int sizeClass = 0; sizeClass < kSizeClassCount; sizeClass++) {
+    while (state->finalizerQueue[sizeClass] != nullptr) {
+      releaseContainerMemory(state, popFinalizerQueue(state, sizeClass));
+    }
   }
+#if USE_BACKGROUND_FREE
+  flushBackgroundFree(state);
+#endif
   RuntimeAssert(state->finalizerQueueSize == 0, "Queue must be empty here");
 }
+
+// Takes container of the given size from the finalizer queue, if any.
+inline ContainerHeader* reuseFinalizedContainer(MemoryState* state, size_t size, bool zeroed) {
+  if (!isSmallSize(size) || !canProcessFinalizerQueue(state)) return nullptr;
+  int sizeClass = sizeClassOf(size);
+  if (state->finalizerQueue[sizeClass] == nullptr) return nullptr;
+  auto* container = popFinalizerQueue(state, sizeClass);
+  if (zeroed) memset(container, 0, size);
+  return container;
+}
 #endif
 
 inline void scheduleDestroyContainer(MemoryState* state, ContainerHeader* container) {
 #if USE_GC
   RuntimeAssert(container != nullptr, "Cannot destroy null container");
-  container->setNextLink(state->finalizerQueue);
-  state->finalizerQueue = container;
+  int sizeClass = prepareContainerForRelease(state, container);
+  container->setNextLink(state->finalizerQueue[sizeClass]);
+  state->finalizerQueue[sizeClass] = container;
   state->finalizerQueueSize++;
-  // We cannot clean finalizer queue while in GC.
-  if (!state->gcInProgress && state->finalizerQueueSuspendCount == 0 && state->finalizerQueueSize > 256) {
+  if (canProcessFinalizerQueue(state) && state->finalizerQueueSize > 256) {
     processFinalizerQueue(state);
   }
 #else
-  atomicAdd(&allocCount, -1);
+  state->allocCount--;
   CONTAINER_DESTROY_EVENT(state, container)
-  konanFreeMemory(container);
+  prepareContainerForRelease(state, container);
+  releaseContainerMemory(state, container);
 #endif
 }
 
@@ -589,19 +2083,73 @@ inline void IncrementRC(ContainerHeader* container) {
 }
 
 template <bool Atomic, bool UseCycleCollector>
-inline void DecrementRC(ContainerHeader* container) {
+inline void DecrementRC(MemoryState* state, ContainerHeader* container) {
   if (container->decRefCount<Atomic>() == 0) {
-    FreeContainer(container);
+    FreeContainer(state, container);
   }
-  UPDATE_RELEASEREF_STAT(memoryState, container, Atomic, false);
+  UPDATE_RELEASEREF_STAT(state, container, Atomic, false);
 }
 
 #else // USE_GC
 
 inline uint32_t freeableSize(MemoryState* state) {
-  return state->toFree->size();
+  uint32_t result = state->toFree != nullptr ? state->toFree->size() : 0;
+#if USE_DEFERRED_STACK_RC
+  result += state->zeroCount->size() - state->zeroCountKept;
+#endif
+  return result;
+}
+
+#if USE_DEFERRED_STACK_RC
+// Calls process for every thread-local container referenced from stack roots of the current thread.
+template <typename func>
+inline void traverseStackRoots(MemoryState* state, func process) {
+  for (auto* frame = state->currentFrame; frame != nullptr; frame = frame->previous) {
+    auto** slot = reinterpret_cast<ObjHeader**>(frame) + frame->count - frame->stackRootCount;
+    for (int index = 0; index < frame->stackRootCount; index++) {
+      auto* object = slot[index];
+      if (object == nullptr) continue;
+      auto* container = object->container();
+      if (container != nullptr && container->normal()) process(container);
+    }
+  }
+}
+
+// Buffers thread-local container having no heap references, CollectZeroCount() or FreeZeroCount() frees it,
+// unless it is referenced from stack roots.
+inline bool bufferZeroCount(MemoryState* state, ContainerHeader* container) {
+  if (container->buffered()) return false;
+  container->setBuffered();
+  state->zeroCount->push_back(container);
+  return true;
 }
 
+// Counts references from stack roots while GC, freezing or subgraph transfer inspect reference counts.
+// Containers which became shareable in the meantime keep these references, as stack roots release
+// shareable objects once updated or left.
+class StackRefsScope {
+ public:
+  explicit StackRefsScope(MemoryState* state) : state_(state) {
+    traverseStackRoots(state, [](ContainerHeader* container) {
+      container->incRefCount<false>();
+    });
+  }
+
+  ~StackRefsScope() {
+    auto* state = state_;
+    traverseStackRoots(state, [state](ContainerHeader* container) {
+      if (container->decRefCount<false>() == 0 && bufferZeroCount(state, container))
+        state->zeroCountKept++;
+    });
+  }
+
+ private:
+  MemoryState* state_;
+};
+
+void FreeZeroCount(MemoryState* state);
+#endif  // USE_DEFERRED_STACK_RC
+
 template <bool Atomic>
 inline void IncrementRC(ContainerHeader* container) {
   container->incRefCount<Atomic>();
@@ -609,32 +2157,62 @@ inline void IncrementRC(ContainerHeader* container) {
   UPDATE_ADDREF_STAT(memoryState, container, Atomic);
 }
 
+// Buffers container which lost a reference as possible root of cyclic garbage, unless it is already buffered
+// or provable acyclic. Returns false in the latter case.
+inline bool rememberPossibleRoot(MemoryState* state, ContainerHeader* container) {
+  int color = container->color();
+  if (color == CONTAINER_TAG_GC_PURPLE || color == CONTAINER_TAG_GC_GREEN) return false;
+  container->setColorAssertIfGreen(CONTAINER_TAG_GC_PURPLE);
+  if (!container->buffered()) {
+    container->setBuffered();
+    state->toFree->push_back(container);
+    if (state->gcSuspendCount == 0 && freeableSize(state) >= state->gcThreshold) {
+      GarbageCollect();
+    }
+  }
+  return true;
+}
+
 template <bool Atomic, bool UseCycleCollector>
-inline void DecrementRC(ContainerHeader* container) {
-  if (container->decRefCount<Atomic>() == 0) {
-    UPDATE_RELEASEREF_STAT(memoryState, container, Atomic, false);
-    FreeContainer(container);
+inline void DecrementRC(MemoryState* state, ContainerHeader* container) {
+  bool released = container->decRefCount<Atomic>() == 0;
+#if USE_WRITE_LOG
+  // Logged stores could refer to thread-local container, see UpdateHeapRef().
+  if (!Atomic && released && state->writeLog.size() != 0) {
+    if (state->writeLog.recordZeroCount(container)) return;
+    // Keeps container alive, as the log could also hold its deferred release.
+    container->incRefCount<false>();
+    FlushWriteLog(state);
+    released = container->decRefCount<false>() == 0;
+  }
+#endif
+  if (released) {
+    UPDATE_RELEASEREF_STAT(state, container, Atomic, false);
+#if USE_DEFERRED_STACK_RC
+    // Thread-local container could still be referenced from stack roots, which are looked at once for all
+    // buffered containers.
+    if (UseCycleCollector && container->stackReferenced()) {
+      if (bufferZeroCount(state, container) &&
+          state->gcSuspendCount == 0 && freeableSize(state) >= state->gcThreshold) {
+        if (state->toFree != nullptr)
+          GarbageCollect();
+        else
+          FreeZeroCount(state);
+      }
+      return;
+    }
+#endif
+    FreeContainer(state, container);
   } else if (UseCycleCollector) { // Possible root.
     RuntimeAssert(!Atomic, "Cycle collector shalln't be used with shared objects yet");
     RuntimeAssert(container->objectCount() == 1,
         "cycle collector shall only work with single object containers");
     // We do not use cycle collector for frozen objects, as we already detected
     // possible cycles during freezing.
-    // Also do not use cycle collector for provable acyclic objects.
-    int color = container->color();
-    if (color != CONTAINER_TAG_GC_PURPLE && color != CONTAINER_TAG_GC_GREEN) {
-      UPDATE_RELEASEREF_STAT(memoryState, container, Atomic, true);
-      container->setColorAssertIfGreen(CONTAINER_TAG_GC_PURPLE);
-      if (!container->buffered()) {
-        container->setBuffered();
-        auto state = memoryState;
-        state->toFree->push_back(container);
-        if (state->gcSuspendCount == 0 && freeableSize(state) >= state->gcThreshold) {
-          GarbageCollect();
-        }
-      }
+    if (rememberPossibleRoot(state, container)) {
+      UPDATE_RELEASEREF_STAT(state, container, Atomic, true);
     } else {
-      UPDATE_RELEASEREF_STAT(memoryState, container, Atomic, false);
+      UPDATE_RELEASEREF_STAT(state, container, Atomic, false);
     }
   }
 }
@@ -782,7 +2360,62 @@ void ScanBlack(ContainerHeader* start) {
 
 void CollectWhite(MemoryState*, ContainerHeader* container);
 
+#if USE_DEFERRED_STACK_RC
+// Frees buffered containers having no references, stack roots are expected to be counted with StackRefsScope.
+void CollectZeroCount(MemoryState* state) {
+  // Freed containers release objects they refer to, which might buffer more containers and trigger new GC.
+  state->gcSuspendCount++;
+  auto* toFree = state->toFree;
+  // Containers of the zero count table are handled together with other candidates.
+  toFree->insert(toFree->end(), state->zeroCount->begin(), state->zeroCount->end());
+  state->zeroCount->clear();
+  state->zeroCountKept = 0;
+  for (size_t index = 0; index < toFree->size(); index++) {
+    auto* container = (*toFree)[index];
+    // Other containers with zero count were already freed, and are left to MarkRoots().
+    if (isMarkedAsRemoved(container) || Shareable(container) || !container->stackReferenced()) continue;
+    if (container->refCount() == 0) {
+      (*toFree)[index] = markAsRemoved(container);
+      container->resetBuffered();
+      FreeContainer(state, container);
+    } else if (container->color() == CONTAINER_TAG_GC_GREEN) {
+      // Acyclic container is alive, and will be buffered again once its count reaches zero.
+      (*toFree)[index] = markAsRemoved(container);
+      container->resetBuffered();
+    }
+  }
+  state->gcSuspendCount--;
+}
+
+// Frees containers of the zero count table no stack root refers to, while GC is stopped.
+void FreeZeroCount(MemoryState* state) {
+  StackRefsScope stackRefs(state);
+  state->gcSuspendCount++;
+  auto* zeroCount = state->zeroCount;
+  for (size_t index = 0; index < zeroCount->size(); index++) {
+    auto* container = (*zeroCount)[index];
+    container->resetBuffered();
+    // Others are alive, or leaked like cyclic garbage is.
+    if (Shareable(container)) {
+      // Buffered container was not destroyed once freed, see MarkRoots().
+      if (container->color() == CONTAINER_TAG_GC_BLACK && container->refCount() == 0)
+        scheduleDestroyContainer(state, container);
+    } else if (container->refCount() == 0) {
+      FreeContainer(state, container);
+    }
+  }
+  zeroCount->clear();
+  state->zeroCountKept = 0;
+  state->gcSuspendCount--;
+}
+#endif
+
 void CollectCycles(MemoryState* state) {
+  // Temporaries of all phases are released at once.
+  ScratchScope scratch;
+#if USE_DEFERRED_STACK_RC
+  CollectZeroCount(state);
+#endif
   MarkRoots(state);
   ScanRoots(state);
   CollectRoots(state);
@@ -893,25 +2526,49 @@ inline void AddRef(ContainerHeader* header) {
   }
 }
 
-inline void ReleaseRef(ContainerHeader* header) {
+inline void ReleaseRef(MemoryState* state, ContainerHeader* header) {
   // Looking at container type we may want to skip ReleaseRef() totally
   // (non-escaping stack objects, constant objects).
   switch (header->tag()) {
     case CONTAINER_TAG_STACK:
       break;
     case CONTAINER_TAG_NORMAL:
-      DecrementRC</* Atomic = */ false, /* UseCyclicCollector = */ true>(header);
+      DecrementRC</* Atomic = */ false, /* UseCyclicCollector = */ true>(state, header);
       break;
     /* case CONTAINER_TAG_FROZEN: case CONTAINER_TAG_ATOMIC: */
     default:
-      DecrementRC</* Atomic = */ true, /* UseCyclicCollector = */ false>(header);
+      DecrementRC</* Atomic = */ true, /* UseCyclicCollector = */ false>(state, header);
       break;
   }
 }
 
+inline void ReleaseRef(ContainerHeader* header) {
+  ReleaseRef(memoryState, header);
+}
+
+inline void ReleaseRef(MemoryState* state, const ObjHeader* object) {
+  auto* container = object->container();
+  if (container != nullptr) {
+    MEMORY_LOG("ReleaseRef on %p in %p\n", object, container)
+    ReleaseRef(state, container);
+  }
+}
+
+// Same as UpdateRef(location, nullptr).
+inline void ClearRef(MemoryState* state, ObjHeader** location) {
+  ObjHeader* old = *location;
+  UPDATE_REF_EVENT(state, old, nullptr, location)
+  if (old != nullptr) {
+    *location = nullptr;
+    if (reinterpret_cast<uintptr_t>(old) > 1) {
+      ReleaseRef(state, old);
+    }
+  }
+}
+
 // We use first slot as place to store frame-local arena container.
-// TODO: create ArenaContainer object on the stack, so that we don't
-// do two allocations per frame (ArenaContainer + actual container).
+// If the compiler reserved FrameArena in the frame, it is already stored there,
+// otherwise arena is allocated in the heap.
 inline ArenaContainer* initedArena(ObjHeader** auxSlot) {
   auto frame = asFrameOverlay(auxSlot);
   auto arena = frame->arena;
@@ -921,25 +2578,55 @@ inline ArenaContainer* initedArena(ObjHeader** auxSlot) {
     arena->Init();
     frame->arena = arena;
   }
+#if USE_FRAME_ARENA
+  else if (!arena->inited()) {
+    MEMORY_LOG("Initializing frame arena in %p\n", frame)
+    auto* frameArena = reinterpret_cast<FrameArena*>(arena);
+    arena->InitInFrame(&frameArena->chunk, kFrameArenaChunkSize);
+  }
+#endif
   return arena;
 }
 
-inline size_t containerSize(const ContainerHeader* container) {
-  size_t result = 0;
-  const ObjHeader* obj = reinterpret_cast<const ObjHeader*>(container + 1);
-  for (int object = 0; object < container->objectCount(); object++) {
-    size_t size = objectSize(obj);
-    result += size;
-    obj = reinterpret_cast<ObjHeader*>(
-        reinterpret_cast<uintptr_t>(obj) + size);
+#if USE_SIZE_CLASS_ALLOCATOR
+constexpr size_t kMetaObjectSize = alignUp(sizeof(MetaObjHeader), kObjectAlignment);
+static_assert(kMetaObjectSize <= kMaxSizeClassSize, "MetaObjHeader must fit size class");
+#endif
+
+// Meta-objects are taken from the same thread-local size class free lists as small containers,
+// as they are created and destroyed often by code using weak references or associated objects.
+// Weak reference counters are objects, so they are pooled as containers.
+// Threads without memory state, such as foreign threads touching frozen objects, use konan::calloc().
+inline MetaObjHeader* allocMetaObject() {
+#if USE_SIZE_CLASS_ALLOCATOR
+  if (::memoryState != nullptr) {
+    void* memory = ::memoryState->allocator.alloc(kMetaObjectSize, true);
+    RuntimeCheck(memory != nullptr, "Cannot alloc memory");
+    auto* meta = new (memory) MetaObjHeader();
+    meta->flags_ = MF_POOLED;
+    return meta;
   }
-  return result;
+#endif
+  return konanConstructInstance<MetaObjHeader>();
+}
+
+inline void freeMetaObject(MetaObjHeader* meta) {
+#if USE_SIZE_CLASS_ALLOCATOR
+  if ((meta->flags_ & MF_POOLED) != 0) {
+    if (::memoryState != nullptr)
+      ::memoryState->allocator.free(meta, sizeClassOf(kMetaObjectSize));
+    else
+      SizeClassAllocator::freeToDepot(meta, sizeClassOf(kMetaObjectSize));
+    return;
+  }
+#endif
+  konanFreeMemory(meta);
 }
 
 }  // namespace
 
 MetaObjHeader* ObjHeader::createMetaObject(TypeInfo** location) {
-  MetaObjHeader* meta = konanConstructInstance<MetaObjHeader>();
+  MetaObjHeader* meta = allocMetaObject();
   TypeInfo* typeInfo = *location;
   RuntimeCheck(!hasPointerBits(typeInfo, OBJECT_TAG_MASK), "Object must not be tagged");
   meta->typeInfo_ = typeInfo;
@@ -949,7 +2636,7 @@ MetaObjHeader* ObjHeader::createMetaObject(TypeInfo** location) {
   TypeInfo* old = __sync_val_compare_and_swap(location, typeInfo, reinterpret_cast<TypeInfo*>(meta));
   if (old->typeInfo_ != old) {
     // Someone installed a new meta-object since the check.
-    konanFreeMemory(meta);
+    freeMetaObject(meta);
     meta = reinterpret_cast<MetaObjHeader*>(old);
   }
 #endif
@@ -968,27 +2655,255 @@ void ObjHeader::destroyMetaObject(TypeInfo** location) {
   Kotlin_ObjCExport_releaseAssociatedObject(meta->associatedObject_);
 #endif
 
-  konanFreeMemory(meta);
+  freeMetaObject(meta);
 }
 
-ContainerHeader* AllocContainer(size_t size) {
-  auto state = memoryState;
+// If zeroed is false, only the container header is zeroed, and the caller must initialize the rest.
+ContainerHeader* AllocContainer(MemoryState* state, size_t size, bool zeroed = true) {
+  size = alignUp(size, kObjectAlignment);
+  ContainerHeader* result = nullptr;
 #if USE_GC
-  // TODO: try to reuse elements of finalizer queue for new allocations, question
-  // is how to get actual size of container.
+  result = reuseFinalizedContainer(state, size, zeroed);
+#endif
+#if USE_LARGE_OBJECT_SPACE
+  if (isLargeObjectSize(size)) {
+    // Mapped memory is always zeroed.
+    result = LargeObjectSpace::alloc(size);
+    RuntimeAssert(result != nullptr, "Cannot alloc memory");
+    if (result == nullptr) return nullptr;
+  }
+#endif
+#if USE_SIZE_CLASS_ALLOCATOR
+  if (result == nullptr && isSmallSize(size)) {
+    result = reinterpret_cast<ContainerHeader*>(state->allocator.alloc(size, zeroed));
+  }
 #endif
-  ContainerHeader* result = konanConstructSizedInstance<ContainerHeader>(alignUp(size, kObjectAlignment));
+  if (result == nullptr) {
+    result = reinterpret_cast<ContainerHeader*>(
+        zeroed ? konanAllocMemory(size) : konanAllocUninitializedMemory(size));
+  }
+  if (!zeroed && result != nullptr) {
+    memset(result, 0, sizeof(ContainerHeader));
+  }
   CONTAINER_ALLOC_EVENT(state, size, result);
 #if TRACE_MEMORY
   state->containers->insert(result);
 #endif
-  atomicAdd(&allocCount, 1);
+  state->allocCount++;
+  state->heapUsed += size;
+  return result;
+}
+
+// Sets the flag for the lifetime of the scope, including unwinding by an exception.
+class ScopedFlag {
+ public:
+  explicit ScopedFlag(bool* flag) : flag_(flag) {
+    *flag_ = true;
+  }
+  ~ScopedFlag() {
+    *flag_ = false;
+  }
+
+ private:
+  bool* flag_;
+};
+
+// Makes sure that allocating size more bytes keeps the worker within its heap quota,
+// collects garbage if needed, and throws OutOfMemoryError if that doesn't help.
+// Only allocations of compiled code are checked, so runtime allocations never throw it and could exceed the quota.
+void EnsureHeapQuota(MemoryState* state, size_t size) {
+  if (state->heapQuota == 0 || state->heapQuotaSuspended) return;
+  int64_t requested = alignUp(size, kObjectAlignment);
+  if (state->heapUsed + requested <= state->heapQuota) return;
+#if USE_GC
+  if (!state->gcInProgress) GarbageCollect();
+#endif
+  if (state->heapUsed + requested <= state->heapQuota) return;
+  MEMORY_LOG("Heap quota %lld exceeded: %lld used, %lld requested\n",
+             static_cast<long long>(state->heapQuota), static_cast<long long>(state->heapUsed),
+             static_cast<long long>(requested))
+  // The exception object itself is allocated regardless of the quota.
+  ScopedFlag suspended(&state->heapQuotaSuspended);
+  ThrowOutOfMemoryError();
+}
+
+MemoryPressureLevel currentMemoryPressureLevel(MemoryState* state) {
+  size_t used = konan::residentMemorySize();
+  // Fall back to the heap of this worker, where process memory usage is not available.
+  if (used == 0 && state->heapUsed > 0) used = state->heapUsed;
+  if (memoryPressureHardLimit != 0 && used >= memoryPressureHardLimit)
+    return MEMORY_PRESSURE_HARD;
+  if (memoryPressureSoftLimit != 0 && used >= memoryPressureSoftLimit)
+    return MEMORY_PRESSURE_SOFT;
+  return MEMORY_PRESSURE_NORMAL;
+}
+
+#if USE_GC
+void adjustGcThresholdToMemoryPressure(MemoryState* state, MemoryPressureLevel level) {
+  if (state->notifiedMemoryPressureLevel == MEMORY_PRESSURE_NORMAL)
+    state->normalGcThreshold = state->gcThreshold;
+  switch (level) {
+    case MEMORY_PRESSURE_NORMAL:
+      initThreshold(state, state->normalGcThreshold);
+      break;
+    case MEMORY_PRESSURE_SOFT: {
+      size_t threshold = state->normalGcThreshold / kSoftPressureGcThresholdDivisor;
+      initThreshold(state, threshold < kMinPressureGcThreshold ? kMinPressureGcThreshold : threshold);
+      break;
+    }
+    case MEMORY_PRESSURE_HARD:
+      initThreshold(state, kMinPressureGcThreshold);
+      break;
+  }
+}
+#endif
+
+// Periodically compares process memory usage with memory pressure limits, and records pressure level
+// observed by this worker. Called while allocating, so the level is acted upon by DeliverMemoryPressure() later.
+void CheckMemoryPressure(MemoryState* state, size_t size) {
+  if (memoryPressureSoftLimit == 0 && memoryPressureHardLimit == 0) return;
+  state->bytesUntilMemoryPressureCheck -= size;
+  if (state->bytesUntilMemoryPressureCheck > 0) return;
+  state->bytesUntilMemoryPressureCheck = kMemoryPressureCheckInterval;
+  state->memoryPressureLevel = currentMemoryPressureLevel(state);
+}
+
+// Once pressure level observed by this worker changes, adjusts GC threshold and notifies listeners registered
+// in GC. Listeners may throw, so it is only called from allocations of compiled code and idle worker.
+void DeliverMemoryPressure(MemoryState* state) {
+  auto level = state->memoryPressureLevel;
+  if (level == state->notifiedMemoryPressureLevel || state->memoryPressureNotifying) return;
+  MEMORY_LOG("Memory pressure level changed from %d to %d\n", state->notifiedMemoryPressureLevel, level)
+#if USE_GC
+  adjustGcThresholdToMemoryPressure(state, level);
+#endif
+  state->notifiedMemoryPressureLevel = level;
+  ScopedFlag notifying(&state->memoryPressureNotifying);
+  OnMemoryPressure(level);
+#if USE_GC
+  if (level == MEMORY_PRESSURE_HARD && !state->gcInProgress) GarbageCollect();
+#endif
+  if (level == MEMORY_PRESSURE_HARD) TrimMemory();
+}
+
+// Called once objects of the heap container are initialized.
+inline void ContainerInitialized(MemoryState* state, ContainerHeader* container, size_t size,
+                                 const TypeInfo* typeInfo) {
+#if USE_ALLOCATION_PROFILER
+  if (AllocationProfiler::enabled())
+    AllocationProfiler::allocated(&state->allocationSampler, container, size, typeInfo);
+#endif
+#if USE_CONTAINER_REGISTRY
+  if (ContainerRegistry::enabled()) ContainerRegistry::add(container, state);
+#endif
+}
+
+#if USE_CONTAINER_REGISTRY
+const char* containerTagName(const ContainerHeader* container) {
+  switch (container->tag()) {
+    case CONTAINER_TAG_NORMAL: return "normal";
+    case CONTAINER_TAG_STACK:  return "stack";
+    case CONTAINER_TAG_FROZEN: return "frozen";
+    case CONTAINER_TAG_ATOMIC: return "atomic";
+  }
+  return "unknown";
+}
+
+// Writes line per object of every registered container: object address, class name, object size,
+// container tag and reference count, followed by addresses of objects referred by the object fields.
+// Objects of other workers are read while they may be modified, so the dump is only consistent
+// if other workers do not run Kotlin code meanwhile.
+bool DumpHeap(const char* path) {
+  void* file = konan::fileOpenForWriting(path);
+  if (file == nullptr) return false;
+  constexpr size_t kFlushSize = 64 * 1024;
+  KStdString buffer;
+  char line[64];
+  bool result = true;
+  buffer += "# address class size tag refCount references...\n";
+  ContainerRegistry::forEach([&](ContainerHeader* container, MemoryState*) {
+    ObjHeader* obj = reinterpret_cast<ObjHeader*>(container + 1);
+    for (int object = 0; object < container->objectCount(); object++) {
+      konan::snprintf(line, sizeof(line) - 1, "%p ", obj);
+      buffer += line;
+      appendTypeName(buffer, obj->type_info());
+      konan::snprintf(line, sizeof(line) - 1, " %u %s %u",
+                      objectSize(obj), containerTagName(container), container->refCount());
+      buffer += line;
+      traverseObjectFields(obj, [&](ObjHeader** location) {
+        if (*location == nullptr) return;
+        konan::snprintf(line, sizeof(line) - 1, " %p", *location);
+        buffer += line;
+      });
+      buffer += '\n';
+      if (buffer.size() >= kFlushSize) {
+        result = konan::fileWrite(file, buffer.data(), buffer.size()) && result;
+        buffer.clear();
+      }
+      obj = reinterpret_cast<ObjHeader*>(
+        reinterpret_cast<uintptr_t>(obj) + objectSize(obj));
+    }
+  });
+  result = konan::fileWrite(file, buffer.data(), buffer.size()) && result;
+  konan::fileClose(file);
   return result;
 }
 
-ContainerHeader* AllocAggregatingFrozenContainer(KStdVector<ContainerHeader*>& containers) {
+// Prints containers of the worker being deinitialized, which are still registered after final garbage
+// collection, grouped by class. Once the last worker is deinitialized, all registered containers are leaked.
+// Note that objects transferred to other workers alive are reported for the worker allocated them.
+void ReportLeaks(MemoryState* state, bool lastMemoryState) {
+  struct Leaks {
+    size_t count;
+    size_t bytes;
+  };
+  KStdUnorderedMap<const TypeInfo*, Leaks> leaksByType;
+  size_t containers = 0;
+  size_t bytes = 0;
+  ContainerRegistry::forEach([&](ContainerHeader* container, MemoryState*& owner) {
+    if (!lastMemoryState && owner != state) return;
+    // Memory state may be reused, so do not attribute the container to this worker any longer.
+    owner = nullptr;
+    containers++;
+    bytes += containerAllocSize(container);
+    ObjHeader* obj = reinterpret_cast<ObjHeader*>(container + 1);
+    for (int object = 0; object < container->objectCount(); object++) {
+      auto& leaks = leaksByType[obj->type_info()];
+      leaks.count++;
+      leaks.bytes += objectSize(obj);
+      obj = reinterpret_cast<ObjHeader*>(
+        reinterpret_cast<uintptr_t>(obj) + objectSize(obj));
+    }
+  });
+  if (containers == 0) return;
+
+  KStdVector<std::pair<const TypeInfo*, Leaks>> sorted(leaksByType.begin(), leaksByType.end());
+  std::sort(sorted.begin(), sorted.end(), [](const std::pair<const TypeInfo*, Leaks>& first,
+                                             const std::pair<const TypeInfo*, Leaks>& second) {
+    return first.second.bytes > second.second.bytes;
+  });
+  char line[128];
+  KStdString report;
+  konan::snprintf(line, sizeof(line) - 1, "*** Memory leaks at %s shutdown: %llu containers, %llu bytes ***\n",
+                  lastMemoryState ? "runtime" : "worker",
+                  static_cast<unsigned long long>(containers), static_cast<unsigned long long>(bytes));
+  report += line;
+  report += "     count      bytes class\n";
+  for (auto& entry : sorted) {
+    konan::snprintf(line, sizeof(line) - 1, "%10llu %10llu ",
+                    static_cast<unsigned long long>(entry.second.count),
+                    static_cast<unsigned long long>(entry.second.bytes));
+    report += line;
+    appendTypeName(report, entry.first);
+    report += '\n';
+  }
+  konan::consoleErrorUtf8(report.data(), report.size());
+}
+#endif  // USE_CONTAINER_REGISTRY
+
+ContainerHeader* AllocAggregatingFrozenContainer(ScratchVector<ContainerHeader*>& containers) {
   auto componentSize = containers.size();
-  auto* superContainer = AllocContainer(sizeof(ContainerHeader) + sizeof(void*) * componentSize);
+  auto* superContainer = AllocContainer(memoryState, sizeof(ContainerHeader) + sizeof(void*) * componentSize);
   auto* place = reinterpret_cast<ContainerHeader**>(superContainer + 1);
   for (auto* container : containers) {
     *place++ = container;
@@ -1002,8 +2917,7 @@ ContainerHeader* AllocAggregatingFrozenContainer(KStdVector<ContainerHeader*>& c
   return superContainer;
 }
 
-void FreeAggregatingFrozenContainer(ContainerHeader* container) {
-  auto* state = memoryState;
+void FreeAggregatingFrozenContainer(MemoryState* state, ContainerHeader* container) {
   RuntimeAssert(isAggregatingFrozenContainer(container), "expected fictitious frozen container");
   MEMORY_LOG("%p is fictitious frozen container\n", container);
   RuntimeAssert(!container->buffered(), "frozen objects must not participate in GC")
@@ -1014,9 +2928,17 @@ void FreeAggregatingFrozenContainer(ContainerHeader* container) {
   // Special container for frozen objects.
   ContainerHeader** subContainer = reinterpret_cast<ContainerHeader**>(container + 1);
   MEMORY_LOG("Total subcontainers = %d\n", container->objectCount());
+  // References between components were not counted, see freezeCyclic(). Clear them while all components
+  // still refer to this container, as headers of freed components are reused by the finalizer queue.
+  for (int i = 0; i < container->objectCount(); ++i) {
+    traverseContainerObjectFields(subContainer[i], [container](ObjHeader** location) {
+      auto* ref = *location;
+      if (ref != nullptr && ref->container() == container) *location = nullptr;
+    });
+  }
   for (int i = 0; i < container->objectCount(); ++i) {
     MEMORY_LOG("Freeing subcontainer %p\n", *subContainer);
-    FreeContainer(*subContainer++);
+    FreeContainer(state, *subContainer++);
   }
 #if USE_GC
   --state->finalizerQueueSuspendCount;
@@ -1025,22 +2947,21 @@ void FreeAggregatingFrozenContainer(ContainerHeader* container) {
   MEMORY_LOG("Freeing subcontainers done\n");
 }
 
-void FreeContainer(ContainerHeader* container) {
+void FreeContainer(MemoryState* state, ContainerHeader* container) {
   RuntimeAssert(container != nullptr, "this kind of container shalln't be freed");
-  auto state = memoryState;
 
   CONTAINER_FREE_EVENT(state, container)
 
   if (isAggregatingFrozenContainer(container)) {
-    FreeAggregatingFrozenContainer(container);
+    FreeAggregatingFrozenContainer(state, container);
     return;
   }
 
   runDeallocationHooks(container);
 
   // Now let's clean all object's fields in this container.
-  traverseContainerObjectFields(container, [](ObjHeader** location) {
-    UpdateRef(location, nullptr);
+  traverseContainerObjectFields(container, [state](ObjHeader** location) {
+    ClearRef(state, location);
   });
 
   // And release underlying memory.
@@ -1051,26 +2972,30 @@ void FreeContainer(ContainerHeader* container) {
   }
 }
 
-void ObjectContainer::Init(const TypeInfo* typeInfo) {
+void ObjectContainer::Init(MemoryState* state, const TypeInfo* typeInfo) {
   RuntimeAssert(typeInfo->instanceSize_ >= 0, "Must be an object");
   uint32_t alloc_size =
       sizeof(ContainerHeader) + typeInfo->instanceSize_;
-  header_ = AllocContainer(alloc_size);
+  CheckMemoryPressure(state, alloc_size);
+  header_ = AllocContainer(state, alloc_size);
   if (header_) {
     // One object in this container.
     header_->setObjectCount(1);
      // header->refCount_ is zero initialized by AllocContainer().
     SetHeader(GetPlace(), typeInfo);
     MEMORY_LOG("object at %p\n", GetPlace())
-    OBJECT_ALLOC_EVENT(memoryState, typeInfo->instanceSize_, GetPlace())
+    OBJECT_ALLOC_EVENT(state, typeInfo->instanceSize_, GetPlace())
+    ContainerInitialized(state, header_, alloc_size, typeInfo);
   }
 }
 
-void ArrayContainer::Init(const TypeInfo* typeInfo, uint32_t elements) {
+void ArrayContainer::Init(MemoryState* state, const TypeInfo* typeInfo, uint32_t elements, bool zeroed) {
   RuntimeAssert(typeInfo->instanceSize_ < 0, "Must be an array");
+  RuntimeAssert(zeroed || typeInfo != theArrayTypeInfo, "Array of references must be zeroed");
   uint32_t alloc_size =
       sizeof(ContainerHeader) + arrayObjectSize(typeInfo, elements);
-  header_ = AllocContainer(alloc_size);
+  CheckMemoryPressure(state, alloc_size);
+  header_ = AllocContainer(state, alloc_size, zeroed);
   RuntimeAssert(header_ != nullptr, "Cannot alloc memory");
   if (header_) {
     // One object in this container.
@@ -1079,50 +3004,72 @@ void ArrayContainer::Init(const TypeInfo* typeInfo, uint32_t elements) {
     GetPlace()->count_ = elements;
     SetHeader(GetPlace()->obj(), typeInfo);
     MEMORY_LOG("array at %p\n", GetPlace())
-    OBJECT_ALLOC_EVENT(
-        memoryState, arrayObjectSize(typeInfo, elements), GetPlace()->obj())
+    OBJECT_ALLOC_EVENT(state, arrayObjectSize(typeInfo, elements), GetPlace()->obj())
+    ContainerInitialized(state, header_, alloc_size, typeInfo);
   }
 }
 
-// TODO: store arena containers in some reuseable data structure, similar to
-// finalizer queue.
 void ArenaContainer::Init() {
-  allocContainer(1024);
+  nextChunkSize_ = kContainerAlignment;
+  allocContainer(kContainerAlignment);
+}
+
+void ArenaContainer::InitInFrame(void* chunk, container_size_t size) {
+  nextChunkSize_ = kContainerAlignment;
+  frameChunk_ = reinterpret_cast<ContainerChunk*>(chunk);
+  useChunk(frameChunk_, size);
 }
 
 void ArenaContainer::Deinit() {
   MEMORY_LOG("Arena::Deinit start: %p\n", this)
+  auto state = memoryState;
   auto chunk = currentChunk_;
   while (chunk != nullptr) {
     // FreeContainer() doesn't release memory when CONTAINER_TAG_STACK is set.
     MEMORY_LOG("Arena::Deinit free chunk %p\n", chunk)
-    FreeContainer(chunk->asHeader());
+    if (chunk->hasReferences) {
+      FreeContainer(state, chunk->asHeader());
+    } else {
+      // Nothing to release but meta-objects, which every arena object has to keep its container.
+      CONTAINER_FREE_EVENT(state, chunk->asHeader())
+      runDeallocationHooks(chunk->asHeader());
+    }
     chunk = chunk->next;
   }
   chunk = currentChunk_;
   while (chunk != nullptr) {
     auto toRemove = chunk;
     chunk = chunk->next;
-    konanFreeMemory(toRemove);
+    if (toRemove != frameChunk_)
+      releaseArenaChunk(state, toRemove);
   }
 }
 
 bool ArenaContainer::allocContainer(container_size_t minSize) {
-  auto size = minSize + sizeof(ContainerHeader) + sizeof(ContainerChunk);
+  container_size_t size = minSize + sizeof(ContainerHeader) + sizeof(ContainerChunk);
   size = alignUp(size, kContainerAlignment);
-  // TODO: keep simple cache of container chunks.
-  ContainerChunk* result = konanConstructSizedInstance<ContainerChunk>(size);
+  if (size < nextChunkSize_) size = nextChunkSize_;
+  if (nextChunkSize_ < kMaxArenaChunkSize) nextChunkSize_ *= 2;
+  ContainerChunk* result = takeCachedArenaChunk(memoryState, size);
+  if (result == nullptr)
+    result = konanConstructSizedInstance<ContainerChunk>(size);
   RuntimeAssert(result != nullptr, "Cannot alloc memory");
   if (result == nullptr) return false;
-  result->next = currentChunk_;
-  result->arena = this;
-  result->asHeader()->refCount_ = (CONTAINER_TAG_STACK | CONTAINER_TAG_INCREMENT);
-  currentChunk_ = result;
-  current_ = reinterpret_cast<uint8_t*>(result->asHeader() + 1);
-  end_ = reinterpret_cast<uint8_t*>(result) + size;
+  useChunk(result, result->size > size ? result->size : size);
   return true;
 }
 
+void ArenaContainer::useChunk(ContainerChunk* chunk, container_size_t size) {
+  chunk->next = currentChunk_;
+  chunk->arena = this;
+  chunk->size = size;
+  chunk->hasReferences = false;
+  chunk->asHeader()->refCount_ = (CONTAINER_TAG_STACK | CONTAINER_TAG_INCREMENT);
+  currentChunk_ = chunk;
+  current_ = reinterpret_cast<uint8_t*>(chunk->asHeader() + 1);
+  end_ = reinterpret_cast<uint8_t*>(chunk) + size;
+}
+
 void* ArenaContainer::place(container_size_t size) {
   size = alignUp(size, kObjectAlignment);
   // Fast path.
@@ -1159,6 +3106,7 @@ ObjHeader* ArenaContainer::PlaceObject(const TypeInfo* type_info) {
   }
   OBJECT_ALLOC_EVENT(memoryState, type_info->instanceSize_, result)
   currentChunk_->asHeader()->incObjectCount();
+  if (type_info->objOffsetsCount_ != 0) currentChunk_->hasReferences = true;
   setHeader(result, type_info);
   return result;
 }
@@ -1172,6 +3120,7 @@ ArrayHeader* ArenaContainer::PlaceArray(const TypeInfo* type_info, uint32_t coun
   }
   OBJECT_ALLOC_EVENT(memoryState, arrayObjectSize(type_info, count), result->obj())
   currentChunk_->asHeader()->incObjectCount();
+  if (type_info == theArrayTypeInfo) currentChunk_->hasReferences = true;
   setHeader(result->obj(), type_info);
   result->count_ = count;
   return result;
@@ -1186,11 +3135,7 @@ inline void AddRef(const ObjHeader* object) {
 }
 
 inline void ReleaseRef(const ObjHeader* object) {
-  auto* container = object->container();
-  if (container != nullptr) {
-    MEMORY_LOG("ReleaseRef on %p in %p\n", object, container)
-    ReleaseRef(container);
-  }
+  ReleaseRef(memoryState, object);
 }
 
 void AddRefFromAssociatedObject(const ObjHeader* object) {
@@ -1201,6 +3146,39 @@ void ReleaseRefFromAssociatedObject(const ObjHeader* object) {
   ReleaseRef(object);
 }
 
+#if USE_WRITE_LOG
+// Applies reference counting deferred by UpdateHeapRef(). All values stored to logged locations are counted
+// before overwritten ones are released, as releases could free containers holding logged locations.
+// Containers which reached zero count meanwhile are held till then, and released afterwards.
+void FlushWriteLog(MemoryState* state) {
+  WriteLog::Entry entries[kWriteLogSize];
+  ContainerHeader* zeroCount[kWriteLogZeroCountSize];
+  int size = state->writeLog.drain(entries);
+  int zeroCountSize = state->writeLog.drainZeroCount(zeroCount);
+  if (size == 0) return;
+  MEMORY_LOG("FlushWriteLog: %d locations, %d zero count containers\n", size, zeroCountSize)
+  // GC must not observe partially applied log.
+  state->gcSuspendCount++;
+  for (int index = 0; index < zeroCountSize; index++) {
+    zeroCount[index]->incRefCount<false>();
+  }
+  for (int index = 0; index < size; index++) {
+    auto** location = entries[index].location;
+    auto* object = *location;
+    if (object != nullptr) AddRef(object);
+  }
+  for (int index = 0; index < size; index++) {
+    auto* old = entries[index].old;
+    if (old != nullptr) ReleaseRef(state, old);
+  }
+  // Container recorded more than once is freed by its last release.
+  for (int index = 0; index < zeroCountSize; index++) {
+    ReleaseRef(state, zeroCount[index]);
+  }
+  state->gcSuspendCount--;
+}
+#endif
+
 extern "C" {
 
 MemoryState* InitMemory() {
@@ -1216,9 +3194,15 @@ MemoryState* InitMemory() {
   RuntimeAssert(memoryState == nullptr, "memory state must be clear");
   memoryState = konanConstructInstance<MemoryState>();
   INIT_EVENT(memoryState)
+#if USE_SIZE_CLASS_ALLOCATOR
+  memoryState->allocator.init();
+#endif
 #if USE_GC
   memoryState->toFree = konanConstructInstance<ContainerHeaderList>();
   memoryState->roots = konanConstructInstance<ContainerHeaderList>();
+#if USE_DEFERRED_STACK_RC
+  memoryState->zeroCount = konanConstructInstance<ContainerHeaderList>();
+#endif
   memoryState->gcInProgress = false;
   initThreshold(memoryState, kGcThreshold);
   memoryState->gcSuspendCount = 0;
@@ -1233,13 +3217,25 @@ void DeinitMemory(MemoryState* memoryState) {
   RuntimeAssert(memoryState->toFree->size() == 0, "Some memory have not been released after GC");
   konanDestructInstance(memoryState->toFree);
   konanDestructInstance(memoryState->roots);
+#if USE_DEFERRED_STACK_RC
+  RuntimeAssert(memoryState->zeroCount->size() == 0, "Some memory have not been released after GC");
+  konanDestructInstance(memoryState->zeroCount);
+#endif
 
-  RuntimeAssert(memoryState->finalizerQueue == nullptr, "Finalizer queue must be empty");
+  for (int sizeClass = 0; sizeClass < kSizeClassCount; sizeClass++)
+    RuntimeAssert(memoryState->finalizerQueue[sizeClass] == nullptr, "Finalizer queue must be empty");
   RuntimeAssert(memoryState->finalizerQueueSize == 0, "Finalizer queue must be empty");
 
 #endif // USE_GC
 
+  // Workers add their counters before being accounted as terminated, so the last one sees the total.
+  atomicAdd(&finishedWorkersAllocCount, memoryState->allocCount);
   bool lastMemoryState = atomicAdd(&aliveMemoryStatesCount, -1) == 0;
+  int allocCount = lastMemoryState ? atomicAdd(&finishedWorkersAllocCount, 0) : 0;
+
+#if USE_CONTAINER_REGISTRY
+  if (leakReportEnabled) ReportLeaks(memoryState, lastMemoryState);
+#endif
 
 #if TRACE_MEMORY
   if (lastMemoryState && allocCount > 0) {
@@ -1256,6 +3252,22 @@ void DeinitMemory(MemoryState* memoryState) {
   PRINT_EVENT(memoryState)
   DEINIT_EVENT(memoryState)
 
+  clearArenaChunkCache(memoryState);
+
+#if USE_BACKGROUND_FREE
+  flushBackgroundFree(memoryState);
+  // Memory shall be returned before the runtime is gone.
+  if (lastMemoryState) BackgroundFreer::stop();
+#endif
+
+#if USE_SIZE_CLASS_ALLOCATOR
+  memoryState->allocator.deinit();
+#endif
+
+#if USE_SCRATCH_ARENA
+  memoryState->scratch.deinit();
+#endif
+
   konanFreeMemory(memoryState);
   ::memoryState = nullptr;
 }
@@ -1271,7 +3283,13 @@ void ResumeMemory(MemoryState* state) {
     ::memoryState = state;
 }
 
-OBJ_GETTER(AllocInstance, const TypeInfo* type_info) {
+MemoryState* CurrentMemoryState() {
+  // Compiled code could be called on a thread not attached to the runtime yet, e.g. from a C callback.
+  if (::memoryState == nullptr) Kotlin_initRuntimeIfNeeded();
+  return ::memoryState;
+}
+
+inline OBJ_GETTER(allocInstance, MemoryState* state, const TypeInfo* type_info) {
   RuntimeAssert(type_info->instanceSize_ >= 0, "must be an object");
   if (isArenaSlot(OBJ_RESULT)) {
     auto arena = initedArena(asArenaSlot(OBJ_RESULT));
@@ -1279,10 +3297,10 @@ OBJ_GETTER(AllocInstance, const TypeInfo* type_info) {
     MEMORY_LOG("instance %p in arena: %p\n", result, arena)
     return result;
   }
-  RETURN_OBJ(ObjectContainer(type_info).GetPlace());
+  RETURN_OBJ(ObjectContainer(state, type_info).GetPlace());
 }
 
-OBJ_GETTER(AllocArrayInstance, const TypeInfo* type_info, int32_t elements) {
+inline OBJ_GETTER(allocArrayInstance, MemoryState* state, const TypeInfo* type_info, int32_t elements) {
   RuntimeAssert(type_info->instanceSize_ < 0, "must be an array");
   if (elements < 0) ThrowIllegalArgumentException();
   if (isArenaSlot(OBJ_RESULT)) {
@@ -1291,7 +3309,39 @@ OBJ_GETTER(AllocArrayInstance, const TypeInfo* type_info, int32_t elements) {
     MEMORY_LOG("array[%d] %p in arena: %p\n", elements, result, arena)
     return result;
   }
-  RETURN_OBJ(ArrayContainer(type_info, elements).GetPlace()->obj());
+  RETURN_OBJ(ArrayContainer(state, type_info, elements).GetPlace()->obj());
+}
+
+OBJ_GETTER(AllocInstance, const TypeInfo* type_info) {
+  RETURN_RESULT_OF(allocInstance, memoryState, type_info);
+}
+
+OBJ_GETTER(AllocInstanceWithState, MemoryState* state, const TypeInfo* type_info) {
+  DeliverMemoryPressure(state);
+  if (!isArenaSlot(OBJ_RESULT))
+    EnsureHeapQuota(state, sizeof(ContainerHeader) + type_info->instanceSize_);
+  RETURN_RESULT_OF(allocInstance, state, type_info);
+}
+
+OBJ_GETTER(AllocArrayInstance, const TypeInfo* type_info, int32_t elements) {
+  RETURN_RESULT_OF(allocArrayInstance, memoryState, type_info, elements);
+}
+
+OBJ_GETTER(AllocArrayInstanceWithState, MemoryState* state, const TypeInfo* type_info, int32_t elements) {
+  DeliverMemoryPressure(state);
+  if (!isArenaSlot(OBJ_RESULT) && elements >= 0)
+    EnsureHeapQuota(state, sizeof(ContainerHeader) + arrayObjectSize(type_info, elements));
+  RETURN_RESULT_OF(allocArrayInstance, state, type_info, elements);
+}
+
+OBJ_GETTER(AllocArrayInstanceUninitialized, const TypeInfo* type_info, int32_t elements) {
+  RuntimeAssert(type_info->instanceSize_ < 0, "must be an array");
+  if (elements < 0) ThrowIllegalArgumentException();
+  if (isArenaSlot(OBJ_RESULT)) {
+    // Arena memory is zeroed anyway.
+    RETURN_RESULT_OF(AllocArrayInstance, type_info, elements);
+  }
+  RETURN_OBJ(ArrayContainer(memoryState, type_info, elements, false).GetPlace()->obj());
 }
 
 OBJ_GETTER(InitInstance,
@@ -1406,21 +3456,29 @@ ObjHeader** GetParamSlotIfArena(ObjHeader* param, ObjHeader** localSlot) {
   return reinterpret_cast<ObjHeader**>(reinterpret_cast<uintptr_t>(&chunk->arena) | ARENA_BIT);
 }
 
-void UpdateRef(ObjHeader** location, const ObjHeader* object) {
+inline void updateRef(MemoryState* state, ObjHeader** location, const ObjHeader* object) {
   RuntimeAssert(!isArenaSlot(location), "must not be a slot");
   ObjHeader* old = *location;
-  UPDATE_REF_EVENT(memoryState, old, object, location)
+  UPDATE_REF_EVENT(state, old, object, location)
   if (old != object) {
     if (object != nullptr) {
       AddRef(object);
     }
     *const_cast<const ObjHeader**>(location) = object;
     if (reinterpret_cast<uintptr_t>(old) > 1) {
-      ReleaseRef(old);
+      ReleaseRef(state, old);
     }
   }
 }
 
+void UpdateRef(ObjHeader** location, const ObjHeader* object) {
+  updateRef(memoryState, location, object);
+}
+
+void UpdateRefWithState(MemoryState* state, ObjHeader** location, const ObjHeader* object) {
+  updateRef(state, location, object);
+}
+
 inline ObjHeader** slotAddressFor(ObjHeader** returnSlot, const ObjHeader* value) {
     if (!isArenaSlot(returnSlot)) return returnSlot;
     // Not a subject of reference counting.
@@ -1441,7 +3499,13 @@ inline void updateReturnRefAdded(ObjHeader** returnSlot, const ObjHeader* value)
 void UpdateReturnRef(ObjHeader** returnSlot, const ObjHeader* value) {
   returnSlot = slotAddressFor(returnSlot, value);
   if (returnSlot == nullptr) return;
-  UpdateRef(returnSlot, value);
+  updateRef(memoryState, returnSlot, value);
+}
+
+void UpdateReturnRefWithState(MemoryState* state, ObjHeader** returnSlot, const ObjHeader* value) {
+  returnSlot = slotAddressFor(returnSlot, value);
+  if (returnSlot == nullptr) return;
+  updateRef(state, returnSlot, value);
 }
 
 void UpdateRefIfNull(ObjHeader** location, const ObjHeader* object) {
@@ -1463,30 +3527,143 @@ void UpdateRefIfNull(ObjHeader** location, const ObjHeader* object) {
   }
 }
 
-void EnterFrame(ObjHeader** start, int parameters, int count) {
-  MEMORY_LOG("EnterFrame %p .. %p\n", start, start + count + parameters)
+void UpdateHeapRef(MemoryState* state, const ObjHeader* holder, ObjHeader** location, const ObjHeader* object) {
+#if USE_WRITE_LOG
+  // Fields of shareable objects could be updated by other workers, so such stores are counted right away.
+  // The log is flushed once holder becomes shareable, so its fields are not logged.
+  if (isThreadLocalRef(holder)) {
+    RuntimeAssert(!isArenaSlot(location), "must not be a slot");
+    ObjHeader* old = *location;
+    if (old == object) return;
+    auto& log = state->writeLog;
+    if (isThreadLocalRef(object) && isThreadLocalRef(old)) {
+      UPDATE_REF_EVENT(state, old, object, location)
+      // Overwritten value to be released once the log is flushed.
+      ObjHeader* counted = reinterpret_cast<uintptr_t>(old) > 1 ? old : nullptr;
+      if (!log.record(location, counted)) {
+        FlushWriteLog(state);
+        log.record(location, counted);
+      }
+      *const_cast<const ObjHeader**>(location) = object;
+      return;
+    }
+    // Value stored to logged location is not counted yet.
+    if (log.contains(location)) FlushWriteLog(state);
+  }
+#endif
+  updateRef(state, location, object);
 }
 
-void LeaveFrame(ObjHeader** start, int parameters, int count) {
-  MEMORY_LOG("LeaveFrame %p .. %p\n", start, start + count + parameters)
-  ReleaseRefs(start + parameters + kFrameOverlaySlots, count - kFrameOverlaySlots - parameters);
-  if (*start != nullptr) {
-    auto arena = initedArena(start);
-    MEMORY_LOG("LeaveFrame: free arena %p\n", arena)
-    arena->Deinit();
-    konanFreeMemory(arena);
-    MEMORY_LOG("LeaveFrame: free arena done %p\n", arena)
+#if USE_BIASED_RC
+inline void acquireSharedStackRef(MemoryState* state, ContainerHeader* container) {
+  auto* entry = state->sharedRefs.entryFor(container);
+  if (entry->container == container) {
+    entry->count++;
+    return;
   }
+  AddRef(container);
+  if (entry->container != nullptr) {
+    if (entry->count != 0) return;
+    // Evict container no longer referenced from the stack.
+    auto* evicted = entry->container;
+    entry->container = nullptr;
+    ReleaseRef(state, evicted);
+  }
+  entry->container = container;
+  entry->count = 1;
 }
 
-void ReleaseRefs(ObjHeader** start, int count) {
+inline void releaseSharedStackRef(MemoryState* state, ContainerHeader* container) {
+  auto* entry = state->sharedRefs.entryFor(container);
+  if (entry->container != container || entry->count == 0) {
+    // Was counted atomically.
+    ReleaseRef(state, container);
+    return;
+  }
+  if (--entry->count == 0 && container->refCount() == 1) {
+    // Garbage is not kept in the cache.
+    entry->container = nullptr;
+    ReleaseRef(state, container);
+  }
+}
+
+// Returns atomic references to cached containers no longer referenced from the stack.
+inline void releaseSharedRefCache(MemoryState* state) {
+  for (auto* entry = state->sharedRefs.begin(); entry != state->sharedRefs.end(); entry++) {
+    auto* container = entry->container;
+    if (container == nullptr || entry->count != 0) continue;
+    entry->container = nullptr;
+    ReleaseRef(state, container);
+  }
+}
+#endif  // USE_BIASED_RC
+
+#if USE_DEFERRED_STACK_RC
+// Stack roots only hold references to shareable objects, see UpdateStackRef().
+inline void releaseStackRef(MemoryState* state, const ObjHeader* object) {
+  auto* container = object->container();
+  if (container == nullptr) return;
+  if (container->shareable()) {
+#if USE_BIASED_RC
+    releaseSharedStackRef(state, container);
+#else
+    ReleaseRef(state, container);
+#endif
+  } else if (container->normal() && container->refCount() != 0 && state->toFree != nullptr) {
+    // The last reference from outside of a garbage cycle could be the dropped one.
+    rememberPossibleRoot(state, container);
+  }
+}
+
+inline void ReleaseStackRefs(MemoryState* state, ObjHeader** start, int count) {
+  MEMORY_LOG("ReleaseStackRefs %p .. %p\n", start, start + count)
+  for (ObjHeader** current = start; current < start + count; current++) {
+    ObjHeader* object = *current;
+    if (object != nullptr) {
+      releaseStackRef(state, object);
+      *current = nullptr;
+    }
+  }
+}
+#endif
+
+void UpdateStackRef(MemoryState* state, ObjHeader** location, const ObjHeader* object) {
+#if USE_DEFERRED_STACK_RC
+  ObjHeader* old = *location;
+  UPDATE_REF_EVENT(state, old, object, location)
+  if (old != object) {
+    // Only shareable objects are counted, as other threads cannot see this stack.
+    if (object != nullptr) {
+      auto* container = object->container();
+      if (container != nullptr) {
+        if (container->shareable()) {
+#if USE_BIASED_RC
+          acquireSharedStackRef(state, container);
+#else
+          AddRef(container);
+#endif
+        } else if (container->normal() && !container->stackReferenced()) {
+          container->setStackReferenced();
+        }
+      }
+    }
+    *const_cast<const ObjHeader**>(location) = object;
+    if (reinterpret_cast<uintptr_t>(old) > 1) {
+      releaseStackRef(state, old);
+    }
+  }
+#else
+  updateRef(state, location, object);
+#endif
+}
+
+inline void releaseRefs(MemoryState* state, ObjHeader** start, int count) {
   MEMORY_LOG("ReleaseRefs %p .. %p\n", start, start + count)
   ObjHeader** current = start;
-  auto state = memoryState;
   while (count-- > 0) {
     ObjHeader* object = *current;
     if (object != nullptr) {
-      ReleaseRef(object);
+      ReleaseRef(state, object);
       // Just for sanity, optional.
       *current = nullptr;
     }
@@ -1494,6 +3671,47 @@ void ReleaseRefs(ObjHeader** start, int count) {
   }
 }
 
+void EnterFrame(MemoryState* state, ObjHeader** start, int parameters, int count, int stackRoots) {
+  MEMORY_LOG("EnterFrame %p .. %p\n", start, start + count)
+#if USE_DEFERRED_STACK_RC
+  auto frame = asFrameOverlay(start);
+  frame->previous = state->currentFrame;
+  frame->count = count;
+  frame->stackRootCount = stackRoots;
+  state->currentFrame = frame;
+#endif
+}
+
+void LeaveFrame(MemoryState* state, ObjHeader** start, int parameters, int count, int stackRoots) {
+  MEMORY_LOG("LeaveFrame %p .. %p\n", start, start + count)
+#if USE_DEFERRED_STACK_RC
+  releaseRefs(state, start + parameters + kFrameOverlaySlots, count - stackRoots - kFrameOverlaySlots - parameters);
+  ReleaseStackRefs(state, start + count - stackRoots, stackRoots);
+  auto frame = asFrameOverlay(start);
+  RuntimeAssert(state->currentFrame == frame, "Frames must be left in reverse order");
+  state->currentFrame = frame->previous;
+#else
+  releaseRefs(state, start + parameters + kFrameOverlaySlots, count - kFrameOverlaySlots - parameters);
+#endif
+  auto arena = asFrameOverlay(start)->arena;
+  // Frame arena which was never used is not inited, and has nothing to release.
+  if (arena != nullptr && arena->inited()) {
+    MEMORY_LOG("LeaveFrame: free arena %p\n", arena)
+#if USE_WRITE_LOG
+    // Fields of arena objects could be logged.
+    FlushWriteLog(state);
+#endif
+    arena->Deinit();
+    if (!arena->inFrame())
+      konanFreeMemory(arena);
+    MEMORY_LOG("LeaveFrame: free arena done %p\n", arena)
+  }
+}
+
+void ReleaseRefs(ObjHeader** start, int count) {
+  releaseRefs(memoryState, start, count);
+}
+
 #if USE_GC
 
 void GarbageCollect() {
@@ -1501,18 +3719,35 @@ void GarbageCollect() {
   RuntimeAssert(!state->gcInProgress, "Recursive GC is disallowed");
 
   MEMORY_LOG("Garbage collect\n")
+  GC_STAT(state)
 
 #if GC_ERGONOMICS
   auto gcStartTime = konan::getTimeMicros();
 #endif
 
-  state->gcInProgress = true;
+#if USE_WRITE_LOG
+  FlushWriteLog(state);
+#endif
+#if USE_BIASED_RC
+  releaseSharedRefCache(state);
+#endif
 
-  processFinalizerQueue(state);
+  state->gcInProgress = true;
 
-  while (state->toFree->size() > 0) {
-    CollectCycles(state);
+  {
+#if USE_DEFERRED_STACK_RC
+    StackRefsScope stackRefs(state);
+#endif
     processFinalizerQueue(state);
+
+    while (state->toFree->size() > 0
+#if USE_DEFERRED_STACK_RC
+        || state->zeroCount->size() > 0
+#endif
+        ) {
+      CollectCycles(state);
+      processFinalizerQueue(state);
+    }
   }
 
   state->gcInProgress = false;
@@ -1531,16 +3766,65 @@ void GarbageCollect() {
              (gcEndTime - gcStartTime), gcStartTime - state->lastGcTimestamp);
   state->lastGcTimestamp = gcEndTime;
 #endif
+
+  if (state->heapBytesFreed >= kGcTrimThreshold) {
+    TrimMemory();
+  }
 }
 
 #endif // USE_GC
 
+void TrimMemory() {
+  auto state = memoryState;
+  MEMORY_LOG("Trim memory, %lld bytes freed since last trim\n", static_cast<long long>(state->heapBytesFreed))
+#if USE_GC
+  if (canProcessFinalizerQueue(state))
+    processFinalizerQueue(state);
+#endif
+  clearArenaChunkCache(state);
+#if USE_BACKGROUND_FREE
+  flushBackgroundFree(state);
+#endif
+#if USE_SIZE_CLASS_ALLOCATOR
+  state->allocator.trim();
+#endif
+  konan::trimMemory();
+  state->heapBytesFreed = 0;
+}
+
+void WorkerIdle() {
+#if USE_BIASED_RC
+  releaseSharedRefCache(memoryState);
+#endif
+#if KONAN_NO_EXCEPTIONS
+  DeliverMemoryPressure(memoryState);
+#else
+  try {
+    DeliverMemoryPressure(memoryState);
+  } catch (ObjHolder& e) {
+    ReportUnhandledException(e.obj());
+  }
+#endif
+  if (memoryState->heapBytesFreed >= kIdleTrimThreshold) {
+    TrimMemory();
+  }
+}
+
 void Kotlin_native_internal_GC_collect(KRef) {
 #if USE_GC
   GarbageCollect();
 #endif
 }
 
+void Kotlin_native_internal_GC_trim(KRef) {
+#if USE_BACKGROUND_FREE
+  // Let memory freed in background be returned too.
+  flushBackgroundFree(memoryState);
+  BackgroundFreer::drain();
+#endif
+  TrimMemory();
+}
+
 void Kotlin_native_internal_GC_suspend(KRef) {
 #if USE_GC
   memoryState->gcSuspendCount++;
@@ -1597,6 +3881,196 @@ KInt Kotlin_native_internal_GC_getThreshold(KRef) {
 #endif
 }
 
+void Kotlin_native_internal_GC_setHeapQuota(KRef, KLong value) {
+  if (value >= 0) {
+    memoryState->heapQuota = value;
+  }
+}
+
+KLong Kotlin_native_internal_GC_getHeapQuota(KRef) {
+  return memoryState->heapQuota;
+}
+
+KLong Kotlin_native_internal_GC_getHeapUsed(KRef) {
+  return memoryState->heapUsed;
+}
+
+KLong Kotlin_native_internal_GC_getHeapReserved(KRef) {
+#if USE_SIZE_CLASS_ALLOCATOR
+  return memoryState->allocator.reservedBytes();
+#else
+  return 0;
+#endif
+}
+
+void Kotlin_native_internal_GC_setCollectStatistic(KRef, KBoolean value) {
+#if COLLECT_STATISTIC
+  memoryStatisticEnabled = value;
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_getCollectStatistic(KRef) {
+#if COLLECT_STATISTIC
+  return memoryStatisticEnabled;
+#else
+  return false;
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_getStatistic(KRef, KRef snapshot) {
+#if COLLECT_STATISTIC
+  ArrayHeader* array = snapshot->array();
+  RuntimeAssert(array->count_ == MemoryStatistic::kSnapshotSize, "Statistic snapshot size mismatch");
+  MemoryStatistic statistic;
+  lock(&finishedWorkersStatisticLock);
+  statistic = finishedWorkersStatistic;
+  unlock(&finishedWorkersStatisticLock);
+  statistic.add(memoryState->statistic);
+  statistic.snapshot(PrimitiveArrayAddressOfElementAt<KLong>(array, 0));
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Kotlin_native_internal_GC_setSoftMemoryLimit(KRef, KLong value) {
+  if (value >= 0) {
+    memoryPressureSoftLimit = value;
+  }
+}
+
+KLong Kotlin_native_internal_GC_getSoftMemoryLimit(KRef) {
+  return memoryPressureSoftLimit;
+}
+
+void Kotlin_native_internal_GC_setHardMemoryLimit(KRef, KLong value) {
+  if (value >= 0) {
+    memoryPressureHardLimit = value;
+  }
+}
+
+KLong Kotlin_native_internal_GC_getHardMemoryLimit(KRef) {
+  return memoryPressureHardLimit;
+}
+
+void Kotlin_native_internal_GC_startAllocationProfiler(KRef, KLong sampleInterval) {
+#if USE_ALLOCATION_PROFILER
+  if (sampleInterval > 0) {
+    AllocationProfiler::start(sampleInterval);
+  }
+#endif
+}
+
+void Kotlin_native_internal_GC_stopAllocationProfiler(KRef) {
+#if USE_ALLOCATION_PROFILER
+  AllocationProfiler::stop();
+#endif
+}
+
+void Kotlin_native_internal_GC_setBackgroundFree(KRef, KBoolean value) {
+#if USE_BACKGROUND_FREE
+  BackgroundFreer::setEnabled(value);
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_getBackgroundFree(KRef) {
+#if USE_BACKGROUND_FREE
+  return BackgroundFreer::enabled();
+#else
+  return false;
+#endif
+}
+
+KLong Kotlin_native_internal_GC_getBackgroundFreedBlocks(KRef) {
+#if USE_BACKGROUND_FREE
+  return BackgroundFreer::freedBlocks();
+#else
+  return 0;
+#endif
+}
+
+void Kotlin_native_internal_GC_setTrackContainers(KRef, KBoolean value) {
+#if USE_CONTAINER_REGISTRY
+  ContainerRegistry::setEnabled(value);
+  if (!value) leakReportEnabled = false;
+#endif
+}
+
+void Kotlin_native_internal_GC_setReportLeaks(KRef, KBoolean value) {
+#if USE_CONTAINER_REGISTRY
+  if (value && !ContainerRegistry::enabled()) ContainerRegistry::setEnabled(true);
+  leakReportEnabled = value;
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_getReportLeaks(KRef) {
+#if USE_CONTAINER_REGISTRY
+  return leakReportEnabled;
+#else
+  return false;
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_getTrackContainers(KRef) {
+#if USE_CONTAINER_REGISTRY
+  return ContainerRegistry::enabled();
+#else
+  return false;
+#endif
+}
+
+KBoolean Kotlin_native_internal_GC_dumpHeap(KRef, KRef path) {
+#if USE_CONTAINER_REGISTRY
+  if (!ContainerRegistry::enabled()) return false;
+  char* cpath = CreateCStringFromString(path);
+  bool result = DumpHeap(cpath);
+  DisposeCString(cpath);
+  return result;
+#else
+  return false;
+#endif
+}
+
+// Fills values with live count, live bytes and allocation count of up to limit classes
+// with the most live bytes, and returns array of their names.
+OBJ_GETTER(Kotlin_native_internal_GC_getTypeHistogram, KRef, KInt limit, KRef values) {
+#if USE_CONTAINER_REGISTRY
+  typedef std::pair<const TypeInfo*, ContainerRegistry::TypeCounters> Entry;
+  KStdVector<Entry> counters;
+  // Copied before any object is allocated, as allocations are registered under the same lock.
+  ContainerRegistry::typeCounters(counters);
+  std::sort(counters.begin(), counters.end(), [](const Entry& first, const Entry& second) {
+    return first.second.liveBytes > second.second.liveBytes;
+  });
+  size_t count = counters.size() < static_cast<size_t>(limit) ? counters.size() : limit;
+  RuntimeAssert(values->array()->count_ >= count * 3, "Histogram values array is too small");
+  KLong* value = PrimitiveArrayAddressOfElementAt<KLong>(values->array(), 0);
+  ObjHolder namesHolder;
+  ObjHeader* names = AllocArrayInstance(theArrayTypeInfo, count, namesHolder.slot());
+  KStdString name;
+  for (size_t index = 0; index < count; index++) {
+    name.clear();
+    appendTypeName(name, counters[index].first);
+    CreateStringFromCString(name.c_str(), ArrayAddressOfElementAt(names->array(), index));
+    *value++ = counters[index].second.liveCount;
+    *value++ = counters[index].second.liveBytes;
+    *value++ = counters[index].second.allocCount;
+  }
+  RETURN_OBJ(names);
+#else
+  return AllocArrayInstance(theArrayTypeInfo, 0, OBJ_RESULT);
+#endif
+}
+
+OBJ_GETTER(Kotlin_native_internal_GC_allocationProfile, KRef, KBoolean live) {
+  KStdString profile;
+#if USE_ALLOCATION_PROFILER
+  // Collected before any object is allocated, as allocations are profiled under the same lock.
+  AllocationProfiler::profile(profile, live);
+#endif
+  RETURN_RESULT_OF(CreateStringFromCString, profile.c_str());
+}
+
 KNativePtr CreateStablePointer(KRef any) {
   if (any == nullptr) return nullptr;
   AddRef(any);
@@ -1626,7 +4100,7 @@ OBJ_GETTER(AdoptStablePointer, KNativePtr pointer) {
 }
 
 #if USE_GC
-bool hasExternalRefs(ContainerHeader* start, ContainerHeaderSet* visited) {
+bool hasExternalRefs(ContainerHeader* start, ScratchUnorderedSet<ContainerHeader*>* visited) {
   ContainerHeaderDeque toVisit;
   toVisit.push_back(start);
   while (!toVisit.empty()) {
@@ -1656,7 +4130,14 @@ bool ClearSubgraphReferences(ObjHeader* root, bool checked) {
       // GC candidate list.
       return true;
 
-    ContainerHeaderSet visited;
+#if USE_WRITE_LOG
+    FlushWriteLog(state);
+#endif
+#if USE_DEFERRED_STACK_RC
+    StackRefsScope stackRefs(state);
+#endif
+    ScratchScope scratch;
+    ScratchUnorderedSet<ContainerHeader*> visited;
     if (!checked) {
       hasExternalRefs(container, &visited);
     } else {
@@ -1692,7 +4173,7 @@ bool ClearSubgraphReferences(ObjHeader* root, bool checked) {
   * When we see GREY during DFS, it means we see cycle.
   */
 void depthFirstTraversal(ContainerHeader* start, bool* hasCycles,
-                         KRef* firstBlocker, KStdVector<ContainerHeader*>* order) {
+                         KRef* firstBlocker, ScratchVector<ContainerHeader*>* order) {
   ContainerHeaderDeque toVisit;
   toVisit.push_back(start);
   start->setSeen();
@@ -1733,9 +4214,9 @@ void depthFirstTraversal(ContainerHeader* start, bool* hasCycles,
 }
 
 void traverseStronglyConnectedComponent(ContainerHeader* start,
-                                        KStdUnorderedMap<ContainerHeader*,
-                                            KStdVector<ContainerHeader*>> const* reversedEdges,
-                                        KStdVector<ContainerHeader*>* component) {
+                                        ScratchUnorderedMap<ContainerHeader*,
+                                            ScratchVector<ContainerHeader*>> const* reversedEdges,
+                                        ScratchVector<ContainerHeader*>* component) {
   ContainerHeaderDeque toVisit;
   toVisit.push_back(start);
   start->mark();
@@ -1756,7 +4237,7 @@ void traverseStronglyConnectedComponent(ContainerHeader* start,
 }
 
 void freezeAcyclic(ContainerHeader* rootContainer) {
-  KStdDeque<ContainerHeader*> queue;
+  ScratchDeque<ContainerHeader*> queue;
   queue.push_back(rootContainer);
   while (!queue.empty()) {
     ContainerHeader* current = queue.front();
@@ -1777,32 +4258,32 @@ void freezeAcyclic(ContainerHeader* rootContainer) {
   }
 }
 
-void freezeCyclic(ContainerHeader* rootContainer, const KStdVector<ContainerHeader*>& order) {
-  KStdUnorderedMap<ContainerHeader*, KStdVector<ContainerHeader*>> reversedEdges;
-  KStdDeque<ContainerHeader*> queue;
+void freezeCyclic(ContainerHeader* rootContainer, const ScratchVector<ContainerHeader*>& order) {
+  ScratchUnorderedMap<ContainerHeader*, ScratchVector<ContainerHeader*>> reversedEdges;
+  ScratchDeque<ContainerHeader*> queue;
   queue.push_back(rootContainer);
   while (!queue.empty()) {
     ContainerHeader* current = queue.front();
     queue.pop_front();
     current->unMark();
-    reversedEdges.emplace(current, KStdVector<ContainerHeader*>(0));
+    reversedEdges.emplace(current, ScratchVector<ContainerHeader*>(0));
     traverseContainerReferredObjects(current, [current, &queue, &reversedEdges](ObjHeader* obj) {
           ContainerHeader* objContainer = obj->container();
           if (!Shareable(objContainer)) {
             if (objContainer->marked())
               queue.push_back(objContainer);
-            reversedEdges.emplace(objContainer, KStdVector<ContainerHeader*>(0)).first->second.push_back(current);
+            reversedEdges.emplace(objContainer, ScratchVector<ContainerHeader*>(0)).first->second.push_back(current);
           }
       });
     }
 
-    KStdVector<KStdVector<ContainerHeader*>> components;
+    ScratchVector<ScratchVector<ContainerHeader*>> components;
     MEMORY_LOG("Condensation:\n");
     // Enumerate in the topological order.
     for (auto it = order.rbegin(); it != order.rend(); ++it) {
       auto* container = *it;
       if (container->marked()) continue;
-      KStdVector<ContainerHeader*> component;
+      ScratchVector<ContainerHeader*> component;
       traverseStronglyConnectedComponent(container, &reversedEdges, &component);
       MEMORY_LOG("SCC:\n");
   #if TRACE_MEMORY
@@ -1873,12 +4354,21 @@ void FreezeSubgraph(ObjHeader* root) {
   // If there are cycles - run graph condensation on cyclic graphs using Kosoraju-Sharir.
   ContainerHeader* rootContainer = root->container();
   if (Shareable(rootContainer)) return;
+#if USE_WRITE_LOG
+  // References to frozen objects must be counted, as other workers can release them.
+  FlushWriteLog(memoryState);
+#endif
+#if USE_DEFERRED_STACK_RC
+  // Frozen objects referenced from the stack must be counted.
+  StackRefsScope stackRefs(memoryState);
+#endif
 
   // Do DFS cycle detection.
   bool hasCycles = false;
   KRef firstBlocker = root->has_meta_object() && ((root->meta_object()->flags_ & MF_NEVER_FROZEN) != 0) ?
     root : nullptr;
-  KStdVector<ContainerHeader*> order;
+  ScratchScope scratch;
+  ScratchVector<ContainerHeader*> order;
   depthFirstTraversal(rootContainer, &hasCycles, &firstBlocker, &order);
   if (firstBlocker != nullptr) {
     ThrowFreezingException(root, firstBlocker);
@@ -1966,8 +4456,9 @@ KBoolean Konan_ensureAcyclicAndSet(ObjHeader* where, KInt index, ObjHeader* what
     if (what != nullptr) {
         // Now we check that `where` is not reachable from `what`.
         // As we cannot modify objects while traversing, instead we remember all seen objects in a set.
-        KStdUnorderedSet<ContainerHeader*> seen;
-        KStdDeque<ContainerHeader*> queue;
+        ScratchScope scratch;
+        ScratchUnorderedSet<ContainerHeader*> seen;
+        ScratchDeque<ContainerHeader*> queue;
         if (what->container() != nullptr)
             queue.push_back(what->container());
         bool acyclic = true;
@@ -2005,6 +4496,12 @@ void Kotlin_Any_share(ObjHeader* obj) {
     auto* container = obj->container();
     if (Shareable(container)) return;
     RuntimeCheck(container->objectCount() == 1, "Must be a single object container");
+#if USE_WRITE_LOG
+    FlushWriteLog(memoryState);
+#endif
+#if USE_DEFERRED_STACK_RC
+    StackRefsScope stackRefs(memoryState);
+#endif
     container->makeShareable();
 }
 
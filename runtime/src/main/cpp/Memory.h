@@ -40,7 +40,7 @@ typedef enum {
   CONTAINER_TAG_MASK = CONTAINER_TAG_INCREMENT - 1,
 
   // Shift to get actual object count.
-  CONTAINER_TAG_GC_SHIFT     = 6,
+  CONTAINER_TAG_GC_SHIFT     = 7,
   CONTAINER_TAG_GC_INCREMENT = 1 << CONTAINER_TAG_GC_SHIFT,
   // Color mask of a container.
   CONTAINER_TAG_COLOR_SHIFT   = 3,
@@ -64,7 +64,9 @@ typedef enum {
   // Individual state bits used during GC and freezing.
   CONTAINER_TAG_GC_MARKED   = 1 << CONTAINER_TAG_COLOR_SHIFT,
   CONTAINER_TAG_GC_BUFFERED = 1 << (CONTAINER_TAG_COLOR_SHIFT + 1),
-  CONTAINER_TAG_GC_SEEN     = 1 << (CONTAINER_TAG_COLOR_SHIFT + 2)
+  CONTAINER_TAG_GC_SEEN     = 1 << (CONTAINER_TAG_COLOR_SHIFT + 2),
+  // Container could be referenced from stack roots, which are not counted.
+  CONTAINER_TAG_GC_STACK_REFERENCED = 1 << (CONTAINER_TAG_COLOR_SHIFT + 3)
 } ContainerTag;
 
 typedef enum {
@@ -78,6 +80,8 @@ typedef enum {
 typedef uint32_t container_size_t;
 
 // Header of all container objects. Contains reference counter.
+// Note that objects are aligned to 8 bytes on all targets, as they may contain Long and Double fields,
+// so packing the header into a single 32-bit word wouldn't make containers any smaller.
 struct ContainerHeader {
   // Reference counter of container. Uses CONTAINER_TAG_SHIFT, lower bits of counter
   // for container type (for polymorphism in ::Release()).
@@ -213,6 +217,14 @@ struct ContainerHeader {
     objectCount_ &= ~CONTAINER_TAG_GC_SEEN;
   }
 
+  inline bool stackReferenced() const {
+    return (objectCount_ & CONTAINER_TAG_GC_STACK_REFERENCED) != 0;
+  }
+
+  inline void setStackReferenced() {
+    objectCount_ |= CONTAINER_TAG_GC_STACK_REFERENCED;
+  }
+
   // We cannot use 'this' here, as it conflicts with aliasing analysis in clang.
   inline void setNextLink(ContainerHeader* next) {
     *reinterpret_cast<ContainerHeader**>(this + 1) = next;
@@ -334,6 +346,8 @@ inline bool PermanentOrFrozen(ObjHeader* obj) {
     return container == nullptr || container->frozen();
 }
 
+struct MemoryState;
+
 // Class representing arbitrary placement container.
 class Container {
  protected:
@@ -354,8 +368,8 @@ class Container {
 class ObjectContainer : public Container {
  public:
   // Single instance.
-  explicit ObjectContainer(const TypeInfo* type_info) {
-    Init(type_info);
+  ObjectContainer(MemoryState* state, const TypeInfo* type_info) {
+    Init(state, type_info);
   }
 
   // Object container shalln't have any dtor, as it's being freed by
@@ -366,14 +380,15 @@ class ObjectContainer : public Container {
   }
 
  private:
-  void Init(const TypeInfo* type_info);
+  void Init(MemoryState* state, const TypeInfo* type_info);
 };
 
 
 class ArrayContainer : public Container {
  public:
-  ArrayContainer(const TypeInfo* type_info, uint32_t elements) {
-    Init(type_info, elements);
+  // If zeroed is false, array elements are left uninitialized.
+  ArrayContainer(MemoryState* state, const TypeInfo* type_info, uint32_t elements, bool zeroed = true) {
+    Init(state, type_info, elements, zeroed);
   }
 
   // Array container shalln't have any dtor, as it's being freed by ::Release().
@@ -383,7 +398,7 @@ class ArrayContainer : public Container {
   }
 
  private:
-  void Init(const TypeInfo* type_info, uint32_t elements);
+  void Init(MemoryState* state, const TypeInfo* type_info, uint32_t elements, bool zeroed);
 };
 
 // Class representing arena-style placement container.
@@ -392,9 +407,13 @@ class ArrayContainer : public Container {
 // whole container can be freed, individual objects are not taken into account.
 class ArenaContainer;
 
-struct ContainerChunk {
+struct alignas(8) ContainerChunk {
   ContainerChunk* next;
   ArenaContainer* arena;
+  // Size of the chunk including this header.
+  container_size_t size;
+  // Whether any object placed in the chunk has reference fields, see ArenaContainer::Deinit().
+  bool hasReferences;
   // Then we have ContainerHeader here.
   ContainerHeader* asHeader() {
     return reinterpret_cast<ContainerHeader*>(this + 1);
@@ -404,8 +423,19 @@ struct ContainerChunk {
 class ArenaContainer {
  public:
   void Init();
+  // Initializes arena placed in the frame, using given memory as its first chunk.
+  void InitInFrame(void* chunk, container_size_t size);
   void Deinit();
 
+  bool inited() const {
+    return currentChunk_ != nullptr;
+  }
+
+  // Arena and its first chunk are placed in the frame, rather than in the heap.
+  bool inFrame() const {
+    return frameChunk_ != nullptr;
+  }
+
   // Place individual object in this container.
   ObjHeader* PlaceObject(const TypeInfo* type_info);
 
@@ -421,6 +451,8 @@ class ArenaContainer {
 
   bool allocContainer(container_size_t minSize);
 
+  void useChunk(ContainerChunk* chunk, container_size_t size);
+
   void setHeader(ObjHeader* obj, const TypeInfo* typeInfo) {
     obj->typeInfoOrMeta_ = const_cast<TypeInfo*>(typeInfo);
     obj->setContainer(currentChunk_->asHeader());
@@ -432,6 +464,10 @@ class ArenaContainer {
   uint8_t* end_;
   ArrayHeader* slots_;
   uint32_t slotsCount_;
+  // Size of the next chunk to allocate, grows geometrically.
+  container_size_t nextChunkSize_;
+  // First chunk, if it is placed in the frame.
+  ContainerChunk* frameChunk_;
 };
 
 #ifdef __cplusplus
@@ -456,14 +492,17 @@ extern "C" {
     return result;                                      \
   }
 
-struct MemoryState;
-
 MemoryState* InitMemory();
 void DeinitMemory(MemoryState*);
 
 MemoryState* SuspendMemory();
 void ResumeMemory(MemoryState* state);
 
+// Memory state of the current thread, initializes runtime on this thread if needed.
+// Compiled code calls it once per function, and passes the result to *WithState() entry points,
+// EnterFrame() and LeaveFrame().
+MemoryState* CurrentMemoryState() RUNTIME_NOTHROW;
+
 //
 // Object allocation.
 //
@@ -478,6 +517,13 @@ void ResumeMemory(MemoryState* state);
 //
 OBJ_GETTER(AllocInstance, const TypeInfo* type_info) RUNTIME_NOTHROW;
 OBJ_GETTER(AllocArrayInstance, const TypeInfo* type_info, int32_t elements);
+// Same as AllocInstance() and AllocArrayInstance(), for compiled code. Unlike them, throw OutOfMemoryError
+// if the heap quota of the worker is exceeded.
+OBJ_GETTER(AllocInstanceWithState, MemoryState* state, const TypeInfo* type_info);
+OBJ_GETTER(AllocArrayInstanceWithState, MemoryState* state, const TypeInfo* type_info, int32_t elements);
+// Same as AllocArrayInstance(), but elements of the heap allocated array are not zeroed,
+// so the caller must overwrite all of them. Only for arrays of primitive types.
+OBJ_GETTER(AllocArrayInstanceUninitialized, const TypeInfo* type_info, int32_t elements);
 void DeinitInstanceBody(const TypeInfo* typeInfo, void* body);
 OBJ_GETTER(InitInstance, ObjHeader** location, const TypeInfo* type_info,
            void (*ctor)(ObjHeader*));
@@ -502,7 +548,8 @@ void WeakReferenceCounterClear(ObjHeader* counter);
 //  - every stack frame has several slots, holding object references (allRefs)
 //  - those are known by compiler (and shall be grouped together)
 //  - it keeps all locally allocated objects in such slot
-//  - all local variables keeping an object also allocate a slot
+//  - all local variables keeping an object also allocate a slot, such stack roots are placed
+//    after other slots, and may be scanned by GC instead of being counted, see UpdateStackRef()
 //  - most manipulations on objects happens in SSA variables and do no affect slots
 //  - exception handlers knowns slot locations for every function, and can update references
 //    in intermediate frames when throwing
@@ -512,10 +559,20 @@ void WeakReferenceCounterClear(ObjHeader* counter);
 void SetRef(ObjHeader** location, const ObjHeader* object) RUNTIME_NOTHROW;
 // Updates location.
 void UpdateRef(ObjHeader** location, const ObjHeader* object) RUNTIME_NOTHROW;
+// Same as UpdateRef(), for compiled code.
+void UpdateRefWithState(MemoryState* state, ObjHeader** location, const ObjHeader* object) RUNTIME_NOTHROW;
 // Updates location if it is null, atomically.
 void UpdateRefIfNull(ObjHeader** location, const ObjHeader* object) RUNTIME_NOTHROW;
+// Updates field of holder, a heap object. Reference counting could be deferred till GC or freezing,
+// unless holder is shareable.
+void UpdateHeapRef(MemoryState* state, const ObjHeader* holder, ObjHeader** location, const ObjHeader* object)
+    RUNTIME_NOTHROW;
+// Updates stack root slot of the current frame, see EnterFrame().
+void UpdateStackRef(MemoryState* state, ObjHeader** location, const ObjHeader* object) RUNTIME_NOTHROW;
 // Updates reference in return slot.
 void UpdateReturnRef(ObjHeader** returnSlot, const ObjHeader* object) RUNTIME_NOTHROW;
+// Same as UpdateReturnRef(), for compiled code.
+void UpdateReturnRefWithState(MemoryState* state, ObjHeader** returnSlot, const ObjHeader* object) RUNTIME_NOTHROW;
 // Compares and swaps reference with taken lock.
 OBJ_GETTER(SwapRefLocked,
     ObjHeader** location, ObjHeader* expectedValue, ObjHeader* newValue, int32_t* spinlock) RUNTIME_NOTHROW;
@@ -525,16 +582,21 @@ void SetRefLocked(ObjHeader** location, ObjHeader* newValue, int32_t* spinlock)
 OBJ_GETTER(ReadRefLocked, ObjHeader** location, int32_t* spinlock) RUNTIME_NOTHROW;
 // Optimization: release all references in range.
 void ReleaseRefs(ObjHeader** start, int count) RUNTIME_NOTHROW;
-// Called on frame enter, if it has object slots.
-void EnterFrame(ObjHeader** start, int parameters, int count) RUNTIME_NOTHROW;
+// Called on frame enter, if it has object slots. Last stackRoots of count slots are updated
+// with UpdateStackRef().
+void EnterFrame(MemoryState* state, ObjHeader** start, int parameters, int count, int stackRoots) RUNTIME_NOTHROW;
 // Called on frame leave, if it has object slots.
-void LeaveFrame(ObjHeader** start, int parameters, int count) RUNTIME_NOTHROW;
+void LeaveFrame(MemoryState* state, ObjHeader** start, int parameters, int count, int stackRoots) RUNTIME_NOTHROW;
 // Tries to use returnSlot's arena for allocation.
 ObjHeader** GetReturnSlotIfArena(ObjHeader** returnSlot, ObjHeader** localSlot) RUNTIME_NOTHROW;
 // Tries to use param's arena for allocation.
 ObjHeader** GetParamSlotIfArena(ObjHeader* param, ObjHeader** localSlot) RUNTIME_NOTHROW;
 // Collect garbage, which cannot be found by reference counting (cycles).
 void GarbageCollect() RUNTIME_NOTHROW;
+// Returns memory freed by this worker and unused memory of malloc heap to the system.
+void TrimMemory() RUNTIME_NOTHROW;
+// Called by worker when its job queue becomes empty.
+void WorkerIdle() RUNTIME_NOTHROW;
 // Clears object subgraph references from memory subsystem, and optionally
 // checks if subgraph referenced by given root is disjoint from the rest of
 // object graph, i.e. no external references exists.
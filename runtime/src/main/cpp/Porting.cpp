@@ -28,6 +28,17 @@
 #include <unistd.h>
 #if KONAN_WINDOWS
 #include <windows.h>
+#elif !KONAN_WASM && !KONAN_ZEPHYR
+#include <sys/mman.h>
+#endif
+#if KONAN_LINUX || KONAN_ANDROID
+#include <fcntl.h>
+#endif
+#if KONAN_LINUX || KONAN_WINDOWS || KONAN_ZEPHYR
+#include <malloc.h>
+#endif
+#if KONAN_MACOSX || KONAN_IOS
+#include <mach/mach.h>
 #endif
 
 #include <chrono>
@@ -105,6 +116,31 @@ int32_t consoleReadUtf8(void* utf8, uint32_t maxSizeBytes) {
 #endif
 }
 
+// File operations.
+#if KONAN_WASM || KONAN_ZEPHYR
+void* fileOpenForWriting(const char* path) {
+  return nullptr;
+}
+
+bool fileWrite(void* file, const void* data, size_t size) {
+  return false;
+}
+
+void fileClose(void* file) {}
+#else
+void* fileOpenForWriting(const char* path) {
+  return ::fopen(path, "wb");
+}
+
+bool fileWrite(void* file, const void* data, size_t size) {
+  return ::fwrite(data, 1, size, reinterpret_cast<FILE*>(file)) == size;
+}
+
+void fileClose(void* file) {
+  ::fclose(reinterpret_cast<FILE*>(file));
+}
+#endif
+
 #if KONAN_INTERNAL_SNPRINTF
 extern "C" int rpl_vsnprintf(char *, size_t, const char *, va_list);
 #define vsnprintf_impl rpl_vsnprintf
@@ -215,11 +251,16 @@ size_t strnlen(const char* buffer, size_t maxSize) {
 // Memory operations.
 #if KONAN_INTERNAL_DLMALLOC
 extern "C" void* dlcalloc(size_t, size_t);
+extern "C" void* dlmalloc(size_t);
 extern "C" void dlfree(void*);
+extern "C" void* dlmemalign(size_t, size_t);
+extern "C" int dlmalloc_trim(size_t);
 #define calloc_impl dlcalloc
+#define malloc_impl dlmalloc
 #define free_impl dlfree
 #else
 #define calloc_impl ::calloc
+#define malloc_impl ::malloc
 #define free_impl ::free
 #endif
 
@@ -227,10 +268,103 @@ void* calloc(size_t count, size_t size) {
   return calloc_impl(count, size);
 }
 
+void* malloc(size_t size) {
+  return malloc_impl(size);
+}
+
+void trimMemory() {
+#if KONAN_INTERNAL_DLMALLOC
+  dlmalloc_trim(0);
+#elif KONAN_LINUX
+  ::malloc_trim(0);
+#endif
+}
+
+size_t residentMemorySize() {
+#if KONAN_LINUX || KONAN_ANDROID
+  // Read without stdio, which would allocate a buffer on every call.
+  int statm = ::open("/proc/self/statm", O_RDONLY);
+  if (statm < 0) return 0;
+  char buffer[128];
+  ssize_t length = ::read(statm, buffer, sizeof(buffer) - 1);
+  ::close(statm);
+  if (length <= 0) return 0;
+  buffer[length] = '\0';
+  // Resident set size in pages is the second field.
+  const char* resident = ::strchr(buffer, ' ');
+  if (resident == nullptr) return 0;
+  unsigned long pages = ::strtoul(resident + 1, nullptr, 10);
+  return pages * ::sysconf(_SC_PAGESIZE);
+#elif KONAN_MACOSX || KONAN_IOS
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (::task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count)
+      != KERN_SUCCESS)
+    return 0;
+  return info.resident_size;
+#else
+  return 0;
+#endif
+}
+
+#if KONAN_WASM || KONAN_ZEPHYR
+void* mapMemory(size_t size, bool hugePages) {
+  return nullptr;
+}
+
+void unmapMemory(void* pointer, size_t size) {
+  ::abort();
+}
+#elif KONAN_WINDOWS
+void* mapMemory(size_t size, bool hugePages) {
+  return ::VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void unmapMemory(void* pointer, size_t size) {
+  ::VirtualFree(pointer, 0, MEM_RELEASE);
+}
+#else
+void* mapMemory(size_t size, bool hugePages) {
+  void* result = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+  if (hugePages) ::madvise(result, size, MADV_HUGEPAGE);
+#endif
+  return result;
+}
+
+void unmapMemory(void* pointer, size_t size) {
+  ::munmap(pointer, size);
+}
+#endif
+
 void free(void* pointer) {
   free_impl(pointer);
 }
 
+void* callocAligned(size_t alignment, size_t size) {
+#if KONAN_INTERNAL_DLMALLOC
+  void* result = dlmemalign(alignment, size);
+#elif KONAN_WINDOWS
+  void* result = ::_aligned_malloc(size, alignment);
+#elif KONAN_ZEPHYR
+  void* result = ::memalign(alignment, size);
+#else
+  void* result = nullptr;
+  if (::posix_memalign(&result, alignment, size) != 0) result = nullptr;
+#endif
+  if (result != nullptr) ::memset(result, 0, size);
+  return result;
+}
+
+void freeAligned(void* pointer) {
+#if KONAN_WINDOWS && !KONAN_INTERNAL_DLMALLOC
+  ::_aligned_free(pointer);
+#else
+  free_impl(pointer);
+#endif
+}
+
 #if KONAN_INTERNAL_NOW
 
 #ifdef KONAN_ZEPHYR
@@ -32,6 +32,12 @@ void consoleErrorUtf8(const void* utf8, uint32_t sizeBytes);
 // Negative return value denotes that read wasn't successful.
 int32_t consoleReadUtf8(void* utf8, uint32_t maxSizeBytes);
 
+// File operations.
+// Creates or truncates file for writing, returns nullptr if failed or not supported on this platform.
+void* fileOpenForWriting(const char* path);
+bool fileWrite(void* file, const void* data, size_t size);
+void fileClose(void* file);
+
 // Process control.
 RUNTIME_NORETURN void abort(void);
 RUNTIME_NORETURN void exit(int32_t status);
@@ -75,7 +81,20 @@ void *memset(void *b, int c, size_t len);
 
 // Memory operations.
 void* calloc(size_t count, size_t size);
+// Unlike calloc(), does not zero allocated memory.
+void* malloc(size_t size);
 void free(void* ptr);
+// Allocates zeroed memory aligned to alignment, a power of two, which must be released with freeAligned().
+void* callocAligned(size_t alignment, size_t size);
+void freeAligned(void* pointer);
+// Maps zeroed memory directly from the system, bypassing malloc heap, optionally backed by huge pages.
+// Returns nullptr, if not supported on this platform.
+void* mapMemory(size_t size, bool hugePages);
+void unmapMemory(void* pointer, size_t size);
+// Returns unused memory of malloc heap to the system, where supported.
+void trimMemory();
+// Resident memory of the process in bytes, or 0 if not available.
+size_t residentMemorySize();
 
 // Time operations.
 uint64_t getTimeMillis();
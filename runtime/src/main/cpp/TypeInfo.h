@@ -58,7 +58,9 @@ enum Konan_TypeFlags {
 };
 
 enum Konan_MetaFlags {
-  MF_NEVER_FROZEN = 1 << 0
+  MF_NEVER_FROZEN = 1 << 0,
+  // Meta-object is a block of the size class allocator, rather than of konan::calloc().
+  MF_POOLED = 1 << 1
 };
 
 // Extended information about a type.
@@ -168,6 +168,11 @@ class Worker {
     pthread_cond_signal(&cond_);
   }
 
+  bool idle() {
+    Locker locker(&lock_);
+    return queue_.size() == 0;
+  }
+
   Job getJob() {
     Locker locker(&lock_);
     while (queue_.size() == 0) {
@@ -375,6 +380,7 @@ void* workerRoutine(void* argument) {
   Kotlin_initRuntimeIfNeeded();
 
   while (true) {
+    if (worker->idle()) WorkerIdle();
     Job job = worker->getJob();
     if (job.function == nullptr) {
        // Termination request, notify the future.
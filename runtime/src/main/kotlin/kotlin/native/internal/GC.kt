@@ -5,6 +5,8 @@
 
 package kotlin.native.internal
 
+import kotlin.native.concurrent.ThreadLocal
+
 /**
  *  ## Cycle garbage collector interface.
  *
@@ -29,6 +31,14 @@ object GC {
     @SymbolName("Kotlin_native_internal_GC_collect")
     external fun collect()
 
+    /**
+     * Return memory released by this worker back to the operating system, where
+     * supported. Memory is also trimmed automatically after collections freeing
+     * a lot of memory and when worker becomes idle.
+     */
+    @SymbolName("Kotlin_native_internal_GC_trim")
+    external fun trim()
+
     /**
      * Suspend garbage collection. Release candidates are still collected, but
      * GC algorithm is not executed.
@@ -68,4 +78,318 @@ object GC {
 
     @SymbolName("Kotlin_native_internal_GC_setThreshold")
     private external fun setThreshold(value: Int)
-}
\ No newline at end of file
+
+    /**
+     * Maximal amount of heap memory in bytes the current worker may hold, or 0 if unlimited.
+     * When allocation would exceed the quota, garbage is collected, and if that doesn't
+     * help, [OutOfMemoryError] is thrown. Memory of objects passed between workers is
+     * accounted to the worker releasing them.
+     */
+    var heapQuota: Long
+        get() = getHeapQuota()
+        set(value) = setHeapQuota(value)
+
+    /**
+     * Amount of heap memory in bytes currently held by the current worker.
+     */
+    val heapUsed: Long
+        get() = getHeapUsed()
+
+    /**
+     * Amount of memory in bytes the current worker keeps for small objects, including memory
+     * of released objects, which is not returned to the operating system until [trim].
+     */
+    val heapReserved: Long
+        get() = getHeapReserved()
+
+    @SymbolName("Kotlin_native_internal_GC_getHeapQuota")
+    private external fun getHeapQuota(): Long
+
+    @SymbolName("Kotlin_native_internal_GC_setHeapQuota")
+    private external fun setHeapQuota(value: Long)
+
+    @SymbolName("Kotlin_native_internal_GC_getHeapUsed")
+    private external fun getHeapUsed(): Long
+
+    @SymbolName("Kotlin_native_internal_GC_getHeapReserved")
+    private external fun getHeapReserved(): Long
+
+    /**
+     * Process memory usage in bytes, above which [MemoryPressure.SOFT] is reported to
+     * memory pressure listeners, and GC runs more often, or 0 if not set.
+     * Memory usage is resident set size of the process where available, and heap memory
+     * of the current worker otherwise.
+     */
+    var softMemoryLimit: Long
+        get() = getSoftMemoryLimit()
+        set(value) = setSoftMemoryLimit(value)
+
+    /**
+     * Process memory usage in bytes, above which [MemoryPressure.HARD] is reported to
+     * memory pressure listeners, and garbage is collected once they are notified, or 0 if not set.
+     */
+    var hardMemoryLimit: Long
+        get() = getHardMemoryLimit()
+        set(value) = setHardMemoryLimit(value)
+
+    /**
+     * Register [listener] to be called on the current worker, when memory pressure level
+     * observed by the worker changes. Memory usage is checked periodically, while worker allocates,
+     * and listeners are called on the next allocation of an object, or once the worker becomes idle.
+     * An exception thrown by a listener propagates to the code allocating the object.
+     */
+    fun addMemoryPressureListener(listener: (MemoryPressure) -> Unit) {
+        MemoryPressureListeners.listeners.add(listener)
+    }
+
+    /**
+     * Unregister [listener] previously registered with [addMemoryPressureListener].
+     */
+    fun removeMemoryPressureListener(listener: (MemoryPressure) -> Unit) {
+        MemoryPressureListeners.listeners.remove(listener)
+    }
+
+    /**
+     * Whether memory manager events are counted. Collection is off by default, as it slows down
+     * reference counting and allocations a bit.
+     */
+    var collectStatistic: Boolean
+        get() = getCollectStatistic()
+        set(value) = setCollectStatistic(value)
+
+    /**
+     * Snapshot of memory manager events counted while [collectStatistic] was enabled, by the current
+     * worker and all terminated workers, or null if statistic is not supported by the runtime.
+     */
+    fun statistic(): MemoryStatistic? {
+        val values = LongArray(MemoryStatistic.SIZE)
+        return if (getStatistic(values)) MemoryStatistic(values) else null
+    }
+
+    /**
+     * Start sampling allocations of all workers, on average once per [sampleInterval] allocated bytes.
+     * Samples taken previously are discarded.
+     */
+    @SymbolName("Kotlin_native_internal_GC_startAllocationProfiler")
+    external fun startAllocationProfiler(sampleInterval: Long = 512 * 1024)
+
+    /**
+     * Stop sampling allocations. Samples taken so far are kept, and ones freed later are still tracked.
+     */
+    @SymbolName("Kotlin_native_internal_GC_stopAllocationProfiler")
+    external fun stopAllocationProfiler()
+
+    /**
+     * Allocation profile in collapsed stack format, accepted by flame graph tools: line per allocation
+     * site, consisting of semicolon separated stack frames, allocated class name and estimated number
+     * of bytes allocated. If [live] is true, only allocations not freed yet are reported.
+     */
+    fun allocationProfile(live: Boolean = false): String = getAllocationProfile(live)
+
+    @SymbolName("Kotlin_native_internal_GC_allocationProfile")
+    private external fun getAllocationProfile(live: Boolean): String
+
+    /**
+     * Whether memory of released objects too large to be recycled is freed by a background thread,
+     * so that releasing lots of garbage at once does not stall the current worker. Off by default.
+     * Not supported on platforms without threads.
+     */
+    var backgroundFree: Boolean
+        get() = getBackgroundFree()
+        set(value) = setBackgroundFree(value)
+
+    /**
+     * Number of memory blocks of released objects freed by the background thread so far, see [backgroundFree].
+     * Blocks still queued for freeing are freed by [trim].
+     */
+    val backgroundFreedBlocks: Long
+        get() = getBackgroundFreedBlocks()
+
+    /**
+     * Whether live heap objects of all workers are tracked, so that [dumpHeap] could write them.
+     * Only objects allocated while tracking is enabled are known. Tracking is off by default,
+     * as it slows down allocations.
+     */
+    var trackContainers: Boolean
+        get() = getTrackContainers()
+        set(value) = setTrackContainers(value)
+
+    /**
+     * Write tracked live objects to file at [path], one per line: object address, class name, size in bytes,
+     * container kind and reference count, followed by addresses of referred objects.
+     * Returns false if [trackContainers] is not enabled, or file cannot be written.
+     */
+    @SymbolName("Kotlin_native_internal_GC_dumpHeap")
+    external fun dumpHeap(path: String): Boolean
+
+    /**
+     * Whether objects still alive after final garbage collection of a terminating worker or runtime
+     * are reported to standard error, grouped by class. Enabling it also enables [trackContainers],
+     * and only objects allocated since then are reported.
+     */
+    var reportLeaks: Boolean
+        get() = getReportLeaks()
+        set(value) = setReportLeaks(value)
+
+    /**
+     * Up to [limit] classes with the most live bytes, among objects allocated since [trackContainers]
+     * was enabled, similar to `jmap -histo`. Empty if containers are not tracked.
+     */
+    fun typeHistogram(limit: Int = 20): List<TypeHistogramEntry> {
+        val values = LongArray(limit * 3)
+        val names = getTypeHistogram(limit, values)
+        return List(names.size) {
+            TypeHistogramEntry(names[it], values[it * 3], values[it * 3 + 1], values[it * 3 + 2])
+        }
+    }
+
+    @SymbolName("Kotlin_native_internal_GC_getTypeHistogram")
+    private external fun getTypeHistogram(limit: Int, values: LongArray): Array<String>
+
+    @SymbolName("Kotlin_native_internal_GC_getBackgroundFree")
+    private external fun getBackgroundFree(): Boolean
+
+    @SymbolName("Kotlin_native_internal_GC_setBackgroundFree")
+    private external fun setBackgroundFree(value: Boolean)
+
+    @SymbolName("Kotlin_native_internal_GC_getBackgroundFreedBlocks")
+    private external fun getBackgroundFreedBlocks(): Long
+
+    @SymbolName("Kotlin_native_internal_GC_getReportLeaks")
+    private external fun getReportLeaks(): Boolean
+
+    @SymbolName("Kotlin_native_internal_GC_setReportLeaks")
+    private external fun setReportLeaks(value: Boolean)
+
+    @SymbolName("Kotlin_native_internal_GC_getTrackContainers")
+    private external fun getTrackContainers(): Boolean
+
+    @SymbolName("Kotlin_native_internal_GC_setTrackContainers")
+    private external fun setTrackContainers(value: Boolean)
+
+    @SymbolName("Kotlin_native_internal_GC_getCollectStatistic")
+    private external fun getCollectStatistic(): Boolean
+
+    @SymbolName("Kotlin_native_internal_GC_setCollectStatistic")
+    private external fun setCollectStatistic(value: Boolean)
+
+    @SymbolName("Kotlin_native_internal_GC_getStatistic")
+    private external fun getStatistic(values: LongArray): Boolean
+
+    @SymbolName("Kotlin_native_internal_GC_getSoftMemoryLimit")
+    private external fun getSoftMemoryLimit(): Long
+
+    @SymbolName("Kotlin_native_internal_GC_setSoftMemoryLimit")
+    private external fun setSoftMemoryLimit(value: Long)
+
+    @SymbolName("Kotlin_native_internal_GC_getHardMemoryLimit")
+    private external fun getHardMemoryLimit(): Long
+
+    @SymbolName("Kotlin_native_internal_GC_setHardMemoryLimit")
+    private external fun setHardMemoryLimit(value: Long)
+}
+
+/**
+ * Kind of container or reference, as counted by [MemoryStatistic].
+ */
+enum class ContainerKind {
+    NORMAL,
+    STACK,
+    PERMANENT,
+    FROZEN,
+    ATOMIC,
+    NULL
+}
+
+/**
+ * Snapshot of memory manager events, see [GC.statistic].
+ */
+class MemoryStatistic internal constructor(private val values: LongArray) {
+    internal companion object {
+        private val KINDS = ContainerKind.values().size
+        private const val SIZE_BUCKETS = 32
+        // Keep layout in sync with MemoryStatistic::snapshot() in Memory.cpp.
+        private const val UPDATES = 0
+        private val ALLOCS = UPDATES + KINDS * KINDS
+        private val HISTOGRAM = ALLOCS + KINDS * 4
+        private val COUNTERS = HISTOGRAM + SIZE_BUCKETS
+        val SIZE = COUNTERS + 7
+    }
+
+    /** Number of reference updates replacing reference to [from] kind with reference to [to] kind. */
+    fun updateRefs(from: ContainerKind, to: ContainerKind): Long = values[UPDATES + from.ordinal * KINDS + to.ordinal]
+
+    /** Number of allocated containers of the given [kind]. */
+    fun containerAllocs(kind: ContainerKind): Long = values[ALLOCS + kind.ordinal * 4]
+
+    /** Number of released containers of the given [kind]. */
+    fun containerFrees(kind: ContainerKind): Long = values[ALLOCS + kind.ordinal * 4 + 1]
+
+    /** Number of allocated objects of the given [kind]. */
+    fun objectAllocs(kind: ContainerKind): Long = values[ALLOCS + kind.ordinal * 4 + 2]
+
+    /**
+     * Histogram of container allocation sizes, element i is number of containers with size
+     * in [2^i, 2^(i+1)) bytes.
+     */
+    val allocationSizes: LongArray get() = values.copyOfRange(HISTOGRAM, HISTOGRAM + SIZE_BUCKETS)
+
+    /** Number of non-atomic reference counter increments. */
+    val addRefs: Long get() = values[COUNTERS]
+
+    /** Number of atomic reference counter increments. */
+    val atomicAddRefs: Long get() = values[COUNTERS + 1]
+
+    /** Number of non-atomic reference counter decrements. */
+    val releaseRefs: Long get() = values[COUNTERS + 2]
+
+    /** Number of atomic reference counter decrements. */
+    val atomicReleaseRefs: Long get() = values[COUNTERS + 3]
+
+    /** Number of reference counter decrements making container a candidate for cycle collection. */
+    val cyclicReleaseRefs: Long get() = values[COUNTERS + 4]
+
+    /** Number of garbage collections. */
+    val gcRuns: Long get() = values[COUNTERS + 5]
+
+    /** Number of bytes of released containers. */
+    val freedBytes: Long get() = values[COUNTERS + 6]
+}
+
+/**
+ * Objects of the class [className], see [GC.typeHistogram].
+ */
+class TypeHistogramEntry internal constructor(
+        val className: String,
+        /** Number of live objects. */
+        val liveCount: Long,
+        /** Size of live objects in bytes. */
+        val liveBytes: Long,
+        /** Number of objects allocated since containers are tracked. */
+        val allocCount: Long
+) {
+    override fun toString() = "$className: $liveCount objects, $liveBytes bytes, $allocCount allocated"
+}
+
+/**
+ * Memory pressure level, as reported to listeners registered with [GC.addMemoryPressureListener].
+ */
+enum class MemoryPressure {
+    NORMAL,
+    SOFT,
+    HARD
+}
+
+@ThreadLocal
+private object MemoryPressureListeners {
+    val listeners = mutableListOf<(MemoryPressure) -> Unit>()
+}
+
+@ExportForCppRuntime
+internal fun OnMemoryPressure(level: Int) {
+    val pressure = MemoryPressure.values()[level]
+    // Listeners may unregister themselves while being notified.
+    for (listener in MemoryPressureListeners.listeners.toList()) {
+        listener(pressure)
+    }
+}